@@ -0,0 +1,38 @@
+#include <fcntl.h> /* open, O_RDWR */
+#include <stdio.h> /* printf */
+#include <string.h> /* memset */
+#include <unistd.h> /* close */
+#include <synccom.h> /* SYNCCOM_* */
+
+int main(void)
+{
+    int fd = 0;
+    char idata[4096];
+    struct synccom_frame_info info;
+    unsigned last_sequence = 0;
+    int i = 0;
+
+    fd = open("/dev/synccom0", O_RDWR);
+
+    for (i = 0; i < 10; i++) {
+        memset(&info, 0, sizeof(info));
+
+        info.buffer = (uintptr_t)idata;
+        info.buffer_size = sizeof(idata);
+
+        if (ioctl(fd, SYNCCOM_READ_FRAME, &info) != 0)
+            break;
+
+        if (last_sequence && info.sequence != last_sequence + 1)
+            printf("%u frame(s) dropped\n", info.sequence - last_sequence - 1);
+
+        printf("#%u: %u bytes, status 0x%04x\n", info.sequence, info.length,
+               info.status);
+
+        last_sequence = info.sequence;
+    }
+
+    close(fd);
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <fcntl.h> /* open, O_RDWR */
+#include <stdio.h> /* printf */
+#include <string.h> /* memset */
+#include <unistd.h> /* close */
+#include <synccom.h> /* SYNCCOM_* */
+
+int main(void)
+{
+    int fd = 0;
+    struct synccom_register_op ops[3];
+    struct synccom_register_batch batch;
+
+    fd = open("/dev/synccom0", O_RDWR);
+
+    memset(ops, 0, sizeof(ops));
+
+    ops[0].op = SYNCCOM_REGISTER_READ;
+    ops[0].offset = 0x18; /* STAR */
+
+    ops[1].op = SYNCCOM_REGISTER_READ;
+    ops[1].offset = 0x0C; /* FIFO_BC */
+
+    ops[2].op = SYNCCOM_REGISTER_READ;
+    ops[2].offset = 0x10; /* FIFO_FC */
+
+    batch.ops = (uintptr_t)ops;
+    batch.count = 3;
+    batch.reserved = 0;
+
+    ioctl(fd, SYNCCOM_REG_BATCH, &batch);
+
+    printf("STAR = 0x%08x\n", ops[0].value);
+    printf("FIFO_BC = 0x%08x\n", ops[1].value);
+    printf("FIFO_FC = 0x%08x\n", ops[2].value);
+
+    close(fd);
+
+    return 0;
+}
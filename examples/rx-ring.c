@@ -0,0 +1,80 @@
+#include <fcntl.h> /* open, O_RDWR */
+#include <poll.h> /* poll */
+#include <stdio.h> /* printf */
+#include <string.h> /* memcpy */
+#include <sys/mman.h> /* mmap, munmap */
+#include <unistd.h> /* close */
+#include <synccom.h> /* SYNCCOM_* */
+
+int main(void)
+{
+    int fd = 0;
+    char idata[4096];
+    struct synccom_mmap_info info;
+    struct synccom_mmap_header *header = 0;
+    struct synccom_rx_desc *descs = 0;
+    unsigned char *ring = 0;
+    unsigned char *data = 0;
+    struct pollfd fds;
+    unsigned head = 0;
+    unsigned tail = 0;
+    int frames = 0;
+
+    fd = open("/dev/synccom0", O_RDWR);
+
+    if (ioctl(fd, SYNCCOM_GET_RX_RING, &info) != 0) {
+        close(fd);
+        return 1;
+    }
+
+    ring = mmap(NULL, info.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                SYNCCOM_RX_RING_OFFSET);
+    if (ring == MAP_FAILED) {
+        close(fd);
+        return 1;
+    }
+
+    header = (struct synccom_mmap_header *)ring;
+    descs = (struct synccom_rx_desc *)(ring + info.desc_offset);
+    data = ring + info.data_offset;
+
+    fds.fd = fd;
+    fds.events = POLLIN;
+
+    tail = header->tail;
+
+    while (frames < 10) {
+        if (poll(&fds, 1, -1) < 0)
+            break;
+
+        head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+
+        for (; tail != head && frames < 10; tail++, frames++) {
+            struct synccom_rx_desc *desc = &descs[tail & (info.desc_count - 1)];
+            unsigned length = desc->length;
+            unsigned first = 0;
+
+            if (length > sizeof(idata))
+                length = sizeof(idata);
+
+            /* Frames can wrap around the end of the data area. */
+            first = info.data_size - desc->offset;
+            if (first > length)
+                first = length;
+
+            memcpy(idata, data + desc->offset, first);
+            memcpy(idata + first, data, length - first);
+
+            printf("#%u: %u bytes, status 0x%04x\n", desc->sequence,
+                   desc->length, desc->status);
+        }
+
+        /* Hand the frames back so their space can be reused. */
+        __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    munmap(ring, info.size);
+    close(fd);
+
+    return 0;
+}
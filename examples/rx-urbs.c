@@ -0,0 +1,24 @@
+#include <fcntl.h> /* open, O_RDWR */
+#include <unistd.h> /* close */
+#include <synccom.h> /* SYNCCOM_* */
+
+int main(void)
+{
+    int fd = 0;
+    struct synccom_rx_urbs rx_urbs;
+
+    fd = open("/dev/synccom0", O_RDWR);
+
+    ioctl(fd, SYNCCOM_GET_RX_URBS, &rx_urbs);
+
+    SYNCCOM_RX_URBS_INIT(rx_urbs);
+
+    rx_urbs.count = 16;
+    rx_urbs.size = 16384;
+
+    ioctl(fd, SYNCCOM_SET_RX_URBS, &rx_urbs);
+
+    close(fd);
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <fcntl.h> /* open, O_RDWR */
+#include <stdio.h> /* sprintf */
+#include <string.h> /* memcpy */
+#include <sys/mman.h> /* mmap, munmap */
+#include <unistd.h> /* close */
+#include <synccom.h> /* SYNCCOM_* */
+
+int main(void)
+{
+    int fd = 0;
+    char odata[20];
+    struct synccom_mmap_info info;
+    struct synccom_mmap_header *header = 0;
+    struct synccom_tx_desc *descs = 0;
+    unsigned char *ring = 0;
+    unsigned char *data = 0;
+    unsigned data_head = 0;
+    unsigned head = 0;
+    unsigned length = 0;
+    int i = 0;
+
+    fd = open("/dev/synccom0", O_RDWR);
+
+    if (ioctl(fd, SYNCCOM_GET_TX_RING, &info) != 0) {
+        close(fd);
+        return 1;
+    }
+
+    ring = mmap(NULL, info.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                SYNCCOM_TX_RING_OFFSET);
+    if (ring == MAP_FAILED) {
+        close(fd);
+        return 1;
+    }
+
+    header = (struct synccom_mmap_header *)ring;
+    descs = (struct synccom_tx_desc *)(ring + info.desc_offset);
+    data = ring + info.data_offset;
+
+    /* The ring is empty to start with, so there is room for these. */
+    head = header->head;
+
+    for (i = 0; i < 16; i++) {
+        struct synccom_tx_desc *desc = &descs[head & (info.desc_count - 1)];
+
+        length = sprintf(odata, "Hello world #%i!", i);
+        memcpy(data + data_head, odata, length);
+
+        desc->offset = data_head;
+        desc->length = length;
+        desc->tx_modifiers = -1;
+
+        data_head += length;
+        head++;
+    }
+
+    __atomic_store_n(&header->head, head, __ATOMIC_RELEASE);
+    ioctl(fd, SYNCCOM_TX_RING_DOORBELL);
+
+    /* Wait for the driver to be done with the frames before unmapping. */
+    while (__atomic_load_n(&header->tail, __ATOMIC_ACQUIRE) != head)
+        usleep(1000);
+
+    munmap(ring, info.size);
+    close(fd);
+
+    return 0;
+}
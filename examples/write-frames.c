@@ -0,0 +1,31 @@
+#include <fcntl.h> /* open, O_RDWR */
+#include <stdio.h> /* sprintf */
+#include <unistd.h> /* close */
+#include <synccom.h> /* SYNCCOM_* */
+
+int main(void)
+{
+    int fd = 0;
+    char odata[16][20];
+    struct synccom_write_frame frame[16];
+    struct synccom_write_frames frames;
+    int i = 0;
+
+    fd = open("/dev/synccom0", O_RDWR);
+
+    for (i = 0; i < 16; i++) {
+        frame[i].buffer = (uintptr_t)odata[i];
+        frame[i].length = sprintf(odata[i], "Hello world #%i!", i);
+        frame[i].tx_modifiers = -1;
+    }
+
+    frames.frames = (uintptr_t)frame;
+    frames.count = 16;
+    frames.reserved = 0;
+
+    ioctl(fd, SYNCCOM_WRITE_FRAMES, &frames);
+
+    close(fd);
+
+    return 0;
+}
@@ -36,6 +36,7 @@ extern "C"
 
 #define SYNCCOM_REGISTERS_INIT(regs) memset(&regs, -1, sizeof(regs))
 #define SYNCCOM_MEMORY_CAP_INIT(memcap) memset(&memcap, -1, sizeof(memcap))
+#define SYNCCOM_RX_URBS_INIT(rx_urbs) memset(&rx_urbs, -1, sizeof(rx_urbs))
 #define SYNCCOM_UPDATE_VALUE -2
 
 enum transmit_type { XF=0, XREP=1, TXT=2, TXEXT=4 };
@@ -80,6 +81,101 @@ struct synccom_memory_cap {
     int output;
 };
 
+struct synccom_rx_urbs {
+    int count;
+    int size;
+};
+
+#define SYNCCOM_REGISTER_READ 0
+#define SYNCCOM_REGISTER_WRITE 1
+
+#define SYNCCOM_MAX_REGISTER_OPS 256
+
+struct synccom_register_op {
+    uint32_t bar;
+    uint32_t offset;
+    uint32_t op;
+    uint32_t value;
+    uint32_t reserved;
+};
+
+struct synccom_register_batch {
+    uint64_t ops; /* struct synccom_register_op * */
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct synccom_frame_info {
+    uint64_t buffer; /* char * */
+    uint32_t buffer_size;
+    uint32_t length;
+    uint32_t status;
+    uint32_t sequence;
+    int64_t timestamp_sec;
+    uint32_t timestamp_nsec;
+    uint32_t reserved;
+};
+
+struct synccom_read_frames {
+    uint64_t frames; /* struct synccom_frame_info * */
+    uint32_t count;
+    uint32_t reserved;
+};
+
+#define SYNCCOM_MAX_WRITE_FRAMES 1024
+
+struct synccom_write_frame {
+    uint64_t buffer; /* const char * */
+    uint32_t length;
+    int32_t tx_modifiers; /* -1 for the port's tx_modifiers */
+};
+
+struct synccom_write_frames {
+    uint64_t frames; /* struct synccom_write_frame * */
+    uint32_t count;
+    uint32_t reserved;
+};
+
+/* mmap() offsets of the receive and transmit rings. */
+#define SYNCCOM_RX_RING_OFFSET 0
+#define SYNCCOM_TX_RING_OFFSET 0x100000
+
+struct synccom_mmap_info {
+    uint32_t size;        /* Bytes to mmap() */
+    uint32_t desc_offset; /* Of the descriptors, from the start of the mapping */
+    uint32_t desc_count;  /* A power of two */
+    uint32_t data_offset; /* Of the data area, from the start of the mapping */
+    uint32_t data_size;   /* A power of two */
+    uint32_t reserved;
+};
+
+/*
+  First thing in the mapping. Both indexes run freely. The driver is the
+  producer of the receive ring and the consumer of the transmit ring.
+*/
+struct synccom_mmap_header {
+    uint32_t head; /* Descriptors filled in, written by the producer */
+    uint32_t tail; /* Descriptors handed back, written by the consumer */
+    uint32_t reserved[14];
+};
+
+struct synccom_rx_desc {
+    uint32_t offset;   /* Of the frame in the data area, modulo data_size */
+    uint32_t length;   /* Frame data, not including the status bytes */
+    uint32_t status;   /* The frame's two status bytes */
+    uint32_t sequence; /* Counts up by one per received frame */
+    int64_t timestamp_sec;
+    uint32_t timestamp_nsec;
+    uint32_t reserved;
+};
+
+struct synccom_tx_desc {
+    uint32_t offset;      /* Of the frame in the data area, modulo data_size */
+    uint32_t length;
+    int32_t tx_modifiers; /* -1 for the port's tx_modifiers */
+    uint32_t reserved;
+};
+
 
 #define SYNCCOM_IOCTL_MAGIC 0x18
 #define TEST _IO(SYNCCOM_IOCTL_MAGIC, 22)
@@ -117,6 +213,24 @@ struct synccom_memory_cap {
 #define SYNCCOM_SET_NONVOLATILE _IOW(SYNCCOM_IOCTL_MAGIC, 29, const unsigned)
 #define SYNCCOM_GET_NONVOLATILE _IOR(SYNCCOM_IOCTL_MAGIC, 30, unsigned *)
 
+#define SYNCCOM_SET_RX_URBS _IOW(SYNCCOM_IOCTL_MAGIC, 32, struct synccom_rx_urbs *)
+#define SYNCCOM_GET_RX_URBS _IOR(SYNCCOM_IOCTL_MAGIC, 33, struct synccom_rx_urbs *)
+
+#define SYNCCOM_REG_BATCH _IOWR(SYNCCOM_IOCTL_MAGIC, 34, struct synccom_register_batch *)
+
+#define SYNCCOM_REFRESH_REGISTERS _IO(SYNCCOM_IOCTL_MAGIC, 35)
+
+#define SYNCCOM_READ_FRAME _IOWR(SYNCCOM_IOCTL_MAGIC, 36, struct synccom_frame_info *)
+
+#define SYNCCOM_READ_FRAMES _IOWR(SYNCCOM_IOCTL_MAGIC, 37, struct synccom_read_frames *)
+
+#define SYNCCOM_WRITE_FRAMES _IOW(SYNCCOM_IOCTL_MAGIC, 38, struct synccom_write_frames *)
+
+#define SYNCCOM_GET_RX_RING _IOR(SYNCCOM_IOCTL_MAGIC, 39, struct synccom_mmap_info *)
+
+#define SYNCCOM_GET_TX_RING _IOR(SYNCCOM_IOCTL_MAGIC, 40, struct synccom_mmap_info *)
+#define SYNCCOM_TX_RING_DOORBELL _IO(SYNCCOM_IOCTL_MAGIC, 41)
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,13 +28,24 @@ THE SOFTWARE.
 #define DEFAULT_INPUT_MEMORY_CAP_VALUE 1000000
 #define DEFAULT_OUTPUT_MEMORY_CAP_VALUE 1000000
 
-#define DEFAULT_TIMEOUT_VALUE 50
+#define DEFAULT_TIMEOUT_VALUE 50 /* STAR reads before giving up on CE */
 #define DEFAULT_FORCE_FIFO_VALUE 0
 #define DEFAULT_APPEND_STATUS_VALUE 0
 #define DEFAULT_APPEND_TIMESTAMP_VALUE 0
 #define DEFAULT_IGNORE_TIMEOUT_VALUE 0
 #define DEFAULT_TX_MODIFIERS_VALUE XF
 #define DEFAULT_RX_MULTIPLE_VALUE 0
+#define DEFAULT_RX_COALESCE_BYTES_VALUE 4096
+#define DEFAULT_RX_COALESCE_USECS_VALUE 1000
+#define DEFAULT_TX_AGGREGATE_BYTES_VALUE 0 /* disabled */
+#define DEFAULT_TX_AGGREGATE_USECS_VALUE 500
+#define DEFAULT_RX_WATERMARK_BYTES_VALUE 0 /* disabled */
+#define DEFAULT_RX_WATERMARK_USECS_VALUE 1000
+
+#define DEFAULT_RX_URB_COUNT 8
+#define DEFAULT_RX_URB_SIZE 512
+#define MAX_RX_URB_COUNT 64
+#define MAX_RX_URB_SIZE 65536
 
 #define DEFAULT_FIFOT_VALUE 0x08001000
 #define DEFAULT_CCR0_VALUE 0x00112004
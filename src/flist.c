@@ -28,7 +28,8 @@ THE SOFTWARE.
 void synccom_flist_init(struct synccom_flist *flist) {
   INIT_LIST_HEAD(&flist->frames);
 
-  flist->estimated_memory_usage = 0;
+  flist->length = 0;
+  flist->memory_usage = 0;
 }
 
 void synccom_flist_delete(struct synccom_flist *flist) {
@@ -41,7 +42,32 @@ void synccom_flist_add_frame(struct synccom_flist *flist,
                              struct synccom_frame *frame) {
   list_add_tail(&frame->list, &flist->frames);
 
-  flist->estimated_memory_usage += synccom_frame_get_length(frame);
+  flist->length++;
+  flist->memory_usage += synccom_frame_get_length(frame);
+}
+
+/* Moves all of frames onto the end of flist, leaving frames empty. */
+void synccom_flist_splice(struct synccom_flist *flist,
+                          struct synccom_flist *frames) {
+  list_splice_tail_init(&frames->frames, &flist->frames);
+
+  flist->length += frames->length;
+  flist->memory_usage += frames->memory_usage;
+
+  frames->length = 0;
+  frames->memory_usage = 0;
+}
+
+/* Moves all of frames onto the front of flist, leaving frames empty. */
+void synccom_flist_splice_front(struct synccom_flist *flist,
+                                struct synccom_flist *frames) {
+  list_splice_init(&frames->frames, &flist->frames);
+
+  flist->length += frames->length;
+  flist->memory_usage += frames->memory_usage;
+
+  frames->length = 0;
+  frames->memory_usage = 0;
 }
 
 struct synccom_frame *synccom_flist_peek_front(struct synccom_flist *flist) {
@@ -69,7 +95,8 @@ struct synccom_frame *synccom_flist_remove_frame(struct synccom_flist *flist) {
 
   list_del(&frame->list);
 
-  flist->estimated_memory_usage -= synccom_frame_get_length(frame);
+  flist->length--;
+  flist->memory_usage -= synccom_frame_get_length(frame);
 
   return frame;
 }
@@ -95,7 +122,8 @@ synccom_flist_remove_frame_if_lte(struct synccom_flist *flist, unsigned size) {
 
   list_del(&frame->list);
 
-  flist->estimated_memory_usage -= synccom_frame_get_length(frame);
+  flist->length--;
+  flist->memory_usage -= synccom_frame_get_length(frame);
 
   return frame;
 }
@@ -114,7 +142,8 @@ void synccom_flist_clear(struct synccom_flist *flist) {
     synccom_frame_delete(current_frame);
   }
 
-  flist->estimated_memory_usage = 0;
+  flist->length = 0;
+  flist->memory_usage = 0;
 }
 
 unsigned synccom_flist_is_empty(struct synccom_flist *flist) {
@@ -122,21 +151,9 @@ unsigned synccom_flist_is_empty(struct synccom_flist *flist) {
 }
 
 unsigned synccom_flist_calculate_memory_usage(struct synccom_flist *flist) {
-  unsigned memory = 0;
-  struct synccom_frame *current_frame = 0;
-
-  list_for_each_entry(current_frame, &flist->frames, list) {
-    memory += synccom_frame_get_length(current_frame);
-  }
-
-  return memory;
+  return flist->memory_usage;
 }
 
 unsigned synccom_flist_length(struct synccom_flist *flist) {
-  unsigned num_frames = 0;
-  struct synccom_frame *current_frame = 0;
-
-  list_for_each_entry(current_frame, &flist->frames, list) { num_frames++; }
-
-  return num_frames;
+  return flist->length;
 }
@@ -36,13 +36,18 @@ THE SOFTWARE.
 
 struct synccom_flist {
   struct list_head frames;
-  unsigned estimated_memory_usage;
+  unsigned length;       /* Number of frames */
+  unsigned memory_usage; /* Data bytes of all of the frames */
 };
 
 void synccom_flist_init(struct synccom_flist *flist);
 void synccom_flist_delete(struct synccom_flist *flist);
 void synccom_flist_add_frame(struct synccom_flist *flist,
                              struct synccom_frame *frame);
+void synccom_flist_splice(struct synccom_flist *flist,
+                          struct synccom_flist *frames);
+void synccom_flist_splice_front(struct synccom_flist *flist,
+                                struct synccom_flist *frames);
 struct synccom_frame *synccom_flist_remove_frame(struct synccom_flist *flist);
 struct synccom_frame *
 synccom_flist_remove_frame_if_lte(struct synccom_flist *flist, unsigned size);
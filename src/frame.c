@@ -22,37 +22,33 @@ THE SOFTWARE.
 
 #include <linux/slab.h> /* kmalloc */
 #include <linux/uaccess.h>
+#include <linux/uio.h> /* copy_from_iter */
 
 #include "frame.h"
 #include "port.h"  /* struct synccom_port */
 #include "utils.h" /* return_{val_}if_true */
 
-static unsigned frame_counter = 1;
-
 int synccom_frame_update_buffer_size(struct synccom_frame *frame,
                                      unsigned length);
+static int synccom_frame_resize_buffer(struct synccom_frame *frame,
+                                       unsigned size, gfp_t malloc_flags);
+
+/* Buffers up to the largest class are recycled per port. */
+static const unsigned frame_buffer_sizes[FRAME_BUFFER_CLASSES] = {256, 1024,
+                                                                  4096};
 
-struct synccom_frame *synccom_frame_new(struct synccom_port *port) {
+struct synccom_frame *synccom_frame_new(struct synccom_port *port,
+                                        gfp_t malloc_flags) {
   struct synccom_frame *frame = 0;
 
-  frame = kmalloc(sizeof(*frame), GFP_ATOMIC);
+  frame = kmem_cache_zalloc(synccom_frame_cache, malloc_flags);
 
   return_val_if_untrue(frame, 0);
 
-  memset(frame, 0, sizeof(*frame));
-
   INIT_LIST_HEAD(&frame->list);
 
-  frame->data_length = 0;
-  frame->buffer_size = 0;
-  frame->buffer = 0;
-  frame->frame_size = 0;
-  frame->lost_bytes = 0;
   frame->port = port;
 
-  frame->number = frame_counter;
-  frame_counter += 1;
-
   return frame;
 }
 
@@ -61,7 +57,7 @@ void synccom_frame_delete(struct synccom_frame *frame) {
 
   synccom_frame_update_buffer_size(frame, 0);
 
-  kfree(frame);
+  kmem_cache_free(synccom_frame_cache, frame);
 }
 
 unsigned synccom_frame_get_length(struct synccom_frame *frame) {
@@ -116,10 +112,11 @@ int synccom_frame_add_data_from_user(struct synccom_frame *frame,
   return_val_if_untrue(frame, 0);
   return_val_if_untrue(length > 0, 0);
 
-  /* Only update buffer size if there isn't enough space already */
+  /* Only update buffer size if there isn't enough space already. This is
+     only called from write() so it is allowed to sleep. */
   if (frame->data_length + length > frame->buffer_size) {
-    if (synccom_frame_update_buffer_size(frame, frame->data_length + length) ==
-        0) {
+    if (synccom_frame_resize_buffer(frame, frame->data_length + length,
+                                    GFP_KERNEL) == 0) {
       return 0;
     }
   }
@@ -134,6 +131,32 @@ int synccom_frame_add_data_from_user(struct synccom_frame *frame,
   return 1;
 }
 
+/*
+  Same as synccom_frame_add_data_from_user, for write_iter(). The buffer is
+  allocated with malloc_flags so IOCB_NOWAIT writes don't wait for memory.
+*/
+int synccom_frame_add_data_from_iter(struct synccom_frame *frame,
+                                     struct iov_iter *from, unsigned length,
+                                     gfp_t malloc_flags) {
+  return_val_if_untrue(frame, 0);
+  return_val_if_untrue(length > 0, 0);
+
+  if (frame->data_length + length > frame->buffer_size) {
+    if (synccom_frame_resize_buffer(frame, frame->data_length + length,
+                                    malloc_flags) == 0) {
+      return 0;
+    }
+  }
+
+  if (copy_from_iter(frame->buffer + frame->data_length, length, from) !=
+      length)
+    return 0;
+
+  frame->data_length += length;
+
+  return 1;
+}
+
 int synccom_frame_transfer_data(struct synccom_frame *destination,
                                 struct synccom_frame *source, unsigned length) {
   unsigned char *new_buffer = 0;
@@ -156,7 +179,7 @@ int synccom_frame_transfer_data(struct synccom_frame *destination,
     return 0;
   }
 
-  new_buffer = kmalloc(length, GFP_ATOMIC);
+  new_buffer = kmalloc(length, GFP_KERNEL);
   if (!new_buffer) {
     dev_warn(source->port->device, "%s - failed to create new_buffer\n",
              __func__);
@@ -212,15 +235,118 @@ void synccom_frame_clear(struct synccom_frame *frame) {
 
 int synccom_frame_update_buffer_size(struct synccom_frame *frame,
                                      unsigned size) {
+  return synccom_frame_resize_buffer(frame, size, GFP_KERNEL);
+}
+
+void synccom_frame_buffers_init(struct synccom_port *port) {
+  int i;
+
+  spin_lock_init(&port->frame_buffer_spinlock);
+
+  for (i = 0; i < FRAME_BUFFER_CLASSES; i++) {
+    INIT_LIST_HEAD(&port->free_frame_buffers[i]);
+    port->free_frame_buffer_count[i] = 0;
+  }
+}
+
+/* Only call once every frame belonging to the port has been deleted. */
+void synccom_frame_buffers_delete(struct synccom_port *port) {
+  struct list_head *current_node = 0;
+  struct list_head *temp_node = 0;
+  int i;
+
+  for (i = 0; i < FRAME_BUFFER_CLASSES; i++) {
+    list_for_each_safe(current_node, temp_node, &port->free_frame_buffers[i]) {
+      list_del(current_node);
+      kfree(current_node);
+    }
+
+    port->free_frame_buffer_count[i] = 0;
+  }
+}
+
+/* The size buffers holding size bytes get, always a multiple of four. */
+static unsigned synccom_frame_buffer_size(unsigned size) {
+  int i;
+
+  for (i = 0; i < FRAME_BUFFER_CLASSES; i++) {
+    if (size <= frame_buffer_sizes[i])
+      return frame_buffer_sizes[i];
+  }
+
+  return ((size % 4) == 0) ? size : size + (4 - (size % 4));
+}
+
+/*
+  Takes a free buffer of the port's matching class if there is one. Free
+  buffers are linked through their first bytes, so nothing else is kept.
+*/
+static char *synccom_frame_get_buffer(struct synccom_port *port,
+                                      unsigned buffer_size,
+                                      gfp_t malloc_flags) {
+  struct list_head *buffer = 0;
+  unsigned long flags = 0;
+  int i;
+
+  for (i = 0; i < FRAME_BUFFER_CLASSES; i++) {
+    if (buffer_size != frame_buffer_sizes[i])
+      continue;
+
+    spin_lock_irqsave(&port->frame_buffer_spinlock, flags);
+    if (!list_empty(&port->free_frame_buffers[i])) {
+      buffer = port->free_frame_buffers[i].next;
+      list_del(buffer);
+      port->free_frame_buffer_count[i]--;
+    }
+    spin_unlock_irqrestore(&port->frame_buffer_spinlock, flags);
+
+    break;
+  }
+
+  if (buffer)
+    return (char *)buffer;
+
+  return kmalloc(buffer_size, malloc_flags);
+}
+
+static void synccom_frame_put_buffer(struct synccom_port *port, char *buffer,
+                                     unsigned buffer_size) {
+  unsigned long flags = 0;
+  int i;
+
+  for (i = 0; i < FRAME_BUFFER_CLASSES; i++) {
+    if (buffer_size != frame_buffer_sizes[i])
+      continue;
+
+    spin_lock_irqsave(&port->frame_buffer_spinlock, flags);
+    if (port->free_frame_buffer_count[i] < FRAME_BUFFER_CACHE_DEPTH) {
+      list_add((struct list_head *)buffer, &port->free_frame_buffers[i]);
+      port->free_frame_buffer_count[i]++;
+      buffer = 0;
+    }
+    spin_unlock_irqrestore(&port->frame_buffer_spinlock, flags);
+
+    break;
+  }
+
+  kfree(buffer);
+}
+
+/*
+  The buffer is always a multiple of four bytes, so it can be handed to the
+  data endpoint as is once the padding is cleared. Resizing within the same
+  buffer class keeps the buffer.
+*/
+static int synccom_frame_resize_buffer(struct synccom_frame *frame,
+                                       unsigned size, gfp_t malloc_flags) {
   char *new_buffer = 0;
-  int malloc_flags = 0;
-  unsigned four_aligned = 0;
+  unsigned buffer_size = 0;
 
   return_val_if_untrue(frame, 0);
 
   if (size == 0) {
     if (frame->buffer) {
-      kfree(frame->buffer);
+      synccom_frame_put_buffer(frame->port, frame->buffer, frame->buffer_size);
       frame->buffer = 0;
     }
 
@@ -230,18 +356,20 @@ int synccom_frame_update_buffer_size(struct synccom_frame *frame,
     return 1;
   }
 
-  four_aligned = ((size % 4)==0) ? size : size + (4 - (size % 4));
-  malloc_flags |= GFP_ATOMIC;
+  buffer_size = synccom_frame_buffer_size(size);
+
+  if (frame->buffer && buffer_size == frame->buffer_size) {
+    frame->data_length = min(frame->data_length, size);
+    return 1;
+  }
 
-  new_buffer = kmalloc(four_aligned, malloc_flags);
+  new_buffer = synccom_frame_get_buffer(frame->port, buffer_size, malloc_flags);
   if (new_buffer == NULL) {
     dev_err(frame->port->device,
             "%s - not enough memory to update frame buffer size\n", __func__);
     return 0;
   }
 
-  memset(new_buffer, 0, four_aligned);
-
   if (frame->buffer) {
     if (frame->data_length) {
       /* Truncate data length if the new buffer size is less than the data
@@ -252,34 +380,117 @@ int synccom_frame_update_buffer_size(struct synccom_frame *frame,
       memmove(new_buffer, frame->buffer, frame->data_length);
     }
 
-    kfree(frame->buffer);
+    synccom_frame_put_buffer(frame->port, frame->buffer, frame->buffer_size);
   }
 
   frame->buffer = new_buffer;
-  frame->buffer_size = four_aligned;
+  frame->buffer_size = buffer_size;
 
   return 1;
 }
 
+/*
+  Drains the hardware's frame length FIFO. Frame lengths are read in batches,
+  each followed by a FIFO_FC read, so frames that arrive while we are working
+  get picked up without an extra round trip.
+
+  Reading BC_FIFO_L pops the length, so the frames are allocated before the
+  batch goes out. A length without a frame would leave its data in istream
+  and misalign every frame after it. register_access_mutex is only held for
+  one batch at a time so other register access can get in between.
+
+  If a batch fails some of its lengths may already have been popped, so the
+  receive side is purged to get istream and the FIFO back in step.
+*/
 void update_bc_buffer(struct synccom_port *port) {
-  int i, frame_count;
-  unsigned long queued_flags = 0;
+  struct synccom_transaction *transaction = 0;
+  int indexes[SYNCCOM_TRANSACTION_MAX_COMMANDS];
+  struct synccom_flist frames;
   struct synccom_frame *frame;
+  unsigned frame_count = 0;
+  unsigned batch_count = 0;
+  unsigned long flags;
+  int fc_index = 0;
+  int status = 0;
+  unsigned i = 0;
 
   mutex_lock(&port->register_access_mutex);
   frame_count = synccom_port_get_register(port, 0, FIFO_FC_OFFSET, 0) & 0x3ff;
+  mutex_unlock(&port->register_access_mutex);
+
   // This loop may never run, and that's actually okay.
-  for (i = 0; i < frame_count; i++) {
-    frame = synccom_frame_new(port);
-    frame->frame_size = synccom_port_get_register(port, 0, BC_FIFO_L_OFFSET, 0);
-    SET_TIMESTAMP(&frame->timestamp);
-    dev_dbg(port->device, "New frame size: %d", frame->frame_size);
-
-    spin_lock_irqsave(&port->queued_iframes_spinlock, queued_flags);
-    synccom_flist_add_frame(&port->queued_iframes, frame);
-    spin_unlock_irqrestore(&port->queued_iframes_spinlock, queued_flags);
+  while (frame_count) {
+    mutex_lock(&port->register_access_mutex);
+
+    transaction = synccom_transaction_get(port);
+    if (!transaction) {
+      mutex_unlock(&port->register_access_mutex);
+      break;
+    }
+
+    batch_count = min(frame_count, transaction->max_commands - 1);
+    synccom_flist_init(&frames);
+
+    for (i = 0; i < batch_count; i++) {
+      frame = synccom_frame_new(port, GFP_KERNEL);
+      if (!frame)
+        break;
+
+      synccom_flist_add_frame(&frames, frame);
+    }
+
+    /* The rest stay in the FIFO until the next run. */
+    batch_count = i;
+    if (batch_count == 0) {
+      synccom_transaction_put(transaction);
+      mutex_unlock(&port->register_access_mutex);
+      break;
+    }
+
+    for (i = 0; i < batch_count; i++)
+      indexes[i] =
+          synccom_transaction_add_read(transaction, 0, BC_FIFO_L_OFFSET);
+
+    fc_index = synccom_transaction_add_read(transaction, 0, FIFO_FC_OFFSET);
+
+    status = synccom_transaction_execute(transaction);
+    if (status != 0) {
+      synccom_transaction_put(transaction);
+      mutex_unlock(&port->register_access_mutex);
+      synccom_flist_clear(&frames);
+
+      dev_err(port->device, "%s: frame lengths lost (%i), purging rx\n",
+              __func__, status);
+
+      spin_lock_irqsave(&port->err_lock, flags);
+      port->errors = -EIO;
+      spin_unlock_irqrestore(&port->err_lock, flags);
+
+      synccom_port_purge_rx(port);
+      break;
+    }
+
+    i = 0;
+    list_for_each_entry(frame, &frames.frames, list) {
+      frame->number = atomic_inc_return(&port->rx_sequence);
+      frame->frame_size =
+          synccom_transaction_get_value(transaction, indexes[i++]);
+      SET_TIMESTAMP(&frame->timestamp);
+      dev_dbg(port->device, "New frame size: %d", frame->frame_size);
+    }
+
+    frame_count = synccom_transaction_get_value(transaction, fc_index) & 0x3ff;
+    synccom_transaction_put(transaction);
+    mutex_unlock(&port->register_access_mutex);
+
+    /* The whole batch goes on in one go. */
+    spin_lock(&port->rx_spinlock);
+    synccom_flist_splice(&port->queued_iframes, &frames);
+    spin_unlock(&port->rx_spinlock);
+
+    /* Let readers start on this batch while we fetch the next one. */
+    wake_up_interruptible(&port->input_queue);
   }
-  mutex_unlock(&port->register_access_mutex);
 
   wake_up_interruptible(&port->input_queue);
 }
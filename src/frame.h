@@ -25,6 +25,8 @@ THE SOFTWARE.
 
 #include "descriptor.h" /* struct synccom_descriptor */
 #include <linux/list.h> /* struct list_head */
+#include <linux/slab.h> /* struct kmem_cache */
+#include <linux/uio.h>  /* struct iov_iter */
 #include <linux/version.h>
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0)
@@ -43,11 +45,15 @@ struct synccom_frame {
   unsigned frame_size;
   unsigned lost_bytes;
   unsigned number;
+  int tx_modifiers; /* Output frames only */
   synccom_timestamp timestamp;
   struct synccom_port *port;
 };
 
-struct synccom_frame *synccom_frame_new(struct synccom_port *port);
+extern struct kmem_cache *synccom_frame_cache;
+
+struct synccom_frame *synccom_frame_new(struct synccom_port *port,
+                                        gfp_t malloc_flags);
 void synccom_frame_delete(struct synccom_frame *frame);
 unsigned synccom_frame_get_length(struct synccom_frame *frame);
 unsigned synccom_frame_get_buffer_size(struct synccom_frame *frame);
@@ -56,6 +62,9 @@ int synccom_frame_add_data(struct synccom_frame *frame, const char *data,
                            unsigned length);
 int synccom_frame_add_data_from_user(struct synccom_frame *frame,
                                      const char *data, unsigned length);
+int synccom_frame_add_data_from_iter(struct synccom_frame *frame,
+                                     struct iov_iter *from, unsigned length,
+                                     gfp_t malloc_flags);
 int synccom_frame_remove_data(struct synccom_frame *frame, char *destination,
                               unsigned length);
 int synccom_frame_transfer_data(struct synccom_frame *destination,
@@ -63,4 +72,6 @@ int synccom_frame_transfer_data(struct synccom_frame *destination,
 unsigned synccom_frame_is_empty(struct synccom_frame *frame);
 void synccom_frame_clear(struct synccom_frame *frame);
 void update_bc_buffer(struct synccom_port *dev);
+void synccom_frame_buffers_init(struct synccom_port *port);
+void synccom_frame_buffers_delete(struct synccom_port *port);
 #endif
@@ -32,6 +32,7 @@ THE SOFTWARE.
 #include <linux/uaccess.h>
 #include <linux/usb.h>
 #include <linux/poll.h>
+#include <linux/uio.h>
 
 /* Define these values to match your devices */
 #define SYNCCOM_VENDOR_ID 0x2eb0
@@ -39,6 +40,10 @@ THE SOFTWARE.
 
 LIST_HEAD(synccom_cards);
 
+/* Runs the frame mode receive work of every port. */
+struct workqueue_struct *synccom_workqueue;
+struct kmem_cache *synccom_frame_cache;
+
 /* table of devices that work with this driver */
 static const struct usb_device_id synccom_table[] = {
     {USB_DEVICE(SYNCCOM_VENDOR_ID, SYNCCOM_PRODUCT_ID)},
@@ -49,8 +54,14 @@ MODULE_DEVICE_TABLE(usb, synccom_table);
 /* Get a minor range for your devices from the usb maintainer */
 #define USB_synccom_MINOR_BASE 192
 
-#define WRITES_IN_FLIGHT 8
-/* arbitrarily chosen */
+static unsigned int rx_urbs = DEFAULT_RX_URB_COUNT;
+module_param(rx_urbs, uint, 0444);
+MODULE_PARM_DESC(rx_urbs, "Number of receive URBs kept in flight per port");
+
+static unsigned int rx_urb_size = DEFAULT_RX_URB_SIZE;
+module_param(rx_urb_size, uint, 0444);
+MODULE_PARM_DESC(rx_urb_size,
+                 "Bytes per receive URB, rounded up to whole USB packets");
 
 /* Structure to hold all device specific stuff */
 
@@ -64,7 +75,27 @@ long synccom_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 static void synccom_delete(struct kref *kref) {
   struct synccom_port *port = to_synccom_dev(kref);
 
-  synccom_port_destroy_urbs(port);
+  /* A probe that failed before initialize() only has the kzalloc'ed port. */
+  if (port->initialized) {
+    /* Stop everything that can kick the workers or the timer before they are
+       cancelled, then free the URBs once nothing can submit them again. */
+    synccom_port_stop_rx(port);
+    hrtimer_cancel(&port->rx_watermark_timer);
+    cancel_delayed_work_sync(&port->bclist_worker);
+    usb_poison_anchored_urbs(&port->submitted);
+    cancel_delayed_work_sync(&port->send_oframe_worker);
+    synccom_port_destroy_urbs(port);
+    synccom_port_destroy_tx_urbs(port);
+    synccom_rx_mmap_delete(port);
+    synccom_tx_mmap_delete(port);
+    synccom_ring_delete(&port->istream);
+    synccom_flist_delete(&port->queued_oframes);
+    synccom_flist_delete(&port->queued_iframes);
+    synccom_frame_delete(port->pending_oframe);
+    synccom_frame_buffers_delete(port);
+    synccom_transaction_pool_delete(port);
+  }
+
   usb_put_dev(port->udev);
   kfree(port);
 }
@@ -95,6 +126,12 @@ static int synccom_open(struct inode *inode, struct file *file) {
   if (retval)
     goto exit;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 13, 0)
+  /* read_iter() and write_iter() honor IOCB_NOWAIT, so io_uring can try
+     them inline and fall back to poll() instead of a worker thread. */
+  file->f_mode |= FMODE_NOWAIT;
+#endif
+
   /* increment our usage count for the device */
   kref_get(&port->kref);
   /* save our object in the file's private structure */
@@ -149,43 +186,84 @@ static int synccom_flush(struct file *file, fl_owner_t id) {
 unsigned synccom_poll(struct file *file, struct poll_table_struct *wait) {
   struct synccom_port *port = 0;
   unsigned mask = 0;
-  int discard = 0;
 
   port = file->private_data;
-  discard = down_interruptible(&port->poll_semaphore);
 
   poll_wait(file, &port->input_queue, wait);
   poll_wait(file, &port->output_queue, wait);
 
-  if(synccom_port_has_incoming_data(port))
+  if (synccom_rx_mmap_is_mapped(port)) {
+    synccom_rx_mmap_update(port);
+
+    if (synccom_rx_mmap_has_frames(port))
+      mask |= POLLIN | POLLRDNORM;
+  } else if(synccom_port_has_incoming_data(port)) {
     mask |= POLLIN | POLLRDNORM;
+  }
 
-  if(synccom_port_get_output_memory_usage(port) < synccom_port_get_output_memory_cap(port))
+  if (synccom_tx_mmap_is_mapped(port)) {
+    if (synccom_tx_mmap_has_space(port))
+      mask |= POLLOUT | POLLWRNORM;
+  } else if(synccom_port_get_output_memory_usage(port) < synccom_port_get_output_memory_cap(port)) {
     mask |= POLLOUT | POLLWRNORM;
-
-  up(&port->poll_semaphore);
+  }
 
   return mask;
 }
 
-static ssize_t synccom_read(struct file *file, char *buf, size_t count,
-                            loff_t *ppos) {
+/* Don't wait for data or memory, return -EAGAIN instead. */
+#define SYNCCOM_NONBLOCK 0x1
+/* Don't sleep at all, not even for the semaphores (IOCB_NOWAIT). */
+#define SYNCCOM_NOWAIT 0x2
+
+static unsigned synccom_file_flags(struct file *file) {
+  return (file->f_flags & O_NONBLOCK) ? SYNCCOM_NONBLOCK : 0;
+}
+
+static unsigned synccom_iocb_flags(struct kiocb *iocb) {
+  unsigned flags = synccom_file_flags(iocb->ki_filp);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 13, 0)
+  if (iocb->ki_flags & IOCB_NOWAIT)
+    flags |= SYNCCOM_NONBLOCK | SYNCCOM_NOWAIT;
+#endif
+
+  return flags;
+}
+
+static int synccom_down(struct semaphore *semaphore, unsigned flags) {
+  if (flags & SYNCCOM_NOWAIT)
+    return down_trylock(semaphore) ? -EAGAIN : 0;
 
+  return down_interruptible(semaphore) ? -ERESTARTSYS : 0;
+}
+
+static ssize_t synccom_read_iter(struct kiocb *iocb, struct iov_iter *to) {
   struct synccom_port *port = 0;
+  unsigned flags = 0;
   ssize_t read_count;
 
-  port = file->private_data;
+  port = iocb->ki_filp->private_data;
+  flags = synccom_iocb_flags(iocb);
 
-  if (count == 0)
-    return count;
+  if (iov_iter_count(to) == 0)
+    return 0;
+
+  /* Nothing will come through read() until the ring is unmapped. */
+  if (!(flags & SYNCCOM_NOWAIT))
+    synccom_rx_mmap_flush(port);
 
-  if (down_interruptible(&port->read_semaphore))
-    return -ERESTARTSYS;
+  if (synccom_rx_mmap_is_mapped(port))
+    return -EBUSY;
+
+  read_count = synccom_down(&port->read_semaphore, flags);
+  if (read_count)
+    return read_count;
 
   while (!synccom_port_has_incoming_data(port)) {
     up(&port->read_semaphore);
 
-    if (file->f_flags & O_NONBLOCK)
+    if (flags & SYNCCOM_NONBLOCK)
       return -EAGAIN;
 
     if (wait_event_interruptible(port->input_queue,
@@ -197,35 +275,33 @@ static ssize_t synccom_read(struct file *file, char *buf, size_t count,
       return -ERESTARTSYS;
   }
 
-  read_count = synccom_port_read(port, buf, count);
+  read_count = synccom_port_read(port, to);
 
   up(&port->read_semaphore);
 
   return read_count;
 }
 
-static ssize_t synccom_write(struct file *file, const char *buf, size_t count,
-                             loff_t *ppos) {
-
-  struct synccom_port *port = 0;
-  int error_code = 0;
-
-  port = file->private_data;
-
-  if (count == 0)
-    return count;
+/*
+  Blocks until count more bytes fit under the output memory cap. Returns 0
+  with write_semaphore held.
+*/
+static long synccom_wait_for_output_space(struct synccom_port *port,
+                                          size_t count, unsigned flags) {
+  long error_code = 0;
 
   if (count > synccom_port_get_output_memory_cap(port))
     return -ENOBUFS;
 
-  if (down_interruptible(&port->write_semaphore))
-    return -ERESTARTSYS;
+  error_code = synccom_down(&port->write_semaphore, flags);
+  if (error_code)
+    return error_code;
 
   while (synccom_port_get_output_memory_usage(port) + count >
          synccom_port_get_output_memory_cap(port)) {
     up(&port->write_semaphore);
 
-    if (file->f_flags & O_NONBLOCK)
+    if (flags & SYNCCOM_NONBLOCK)
       return -EAGAIN;
 
     if (wait_event_interruptible(
@@ -242,13 +318,257 @@ static ssize_t synccom_write(struct file *file, const char *buf, size_t count,
       return -ERESTARTSYS;
   }
 
-  error_code = synccom_port_write(port, buf, count);
+  return 0;
+}
+
+static ssize_t synccom_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+  struct synccom_port *port = 0;
+  size_t count = iov_iter_count(from);
+  unsigned flags = 0;
+  int error_code = 0;
+
+  port = iocb->ki_filp->private_data;
+  flags = synccom_iocb_flags(iocb);
+
+  if (count == 0)
+    return count;
+
+  error_code = synccom_wait_for_output_space(port, count, flags);
+  if (error_code)
+    return error_code;
+
+  if (flags & SYNCCOM_NOWAIT) {
+    error_code = synccom_port_write(port, from, GFP_NOWAIT);
+    if (error_code == -ENOMEM)
+      error_code = -EAGAIN;
+  } else {
+    error_code = synccom_port_write(port, from, GFP_KERNEL);
+  }
 
   up(&port->write_semaphore);
 
   return (error_code < 0) ? error_code : count;
 }
 
+static long synccom_ioctl_register_batch(struct synccom_port *port,
+                                         unsigned long arg) {
+  struct synccom_register_batch batch;
+  struct synccom_register_op *ops = 0;
+  long error_code = 0;
+
+  if (copy_from_user(&batch, (void *)arg, sizeof(batch))) {
+    return -EFAULT;
+  }
+
+  if (batch.count == 0)
+    return 0;
+
+  if (batch.count > SYNCCOM_MAX_REGISTER_OPS)
+    return -EINVAL;
+
+  ops = kmalloc_array(batch.count, sizeof(*ops), GFP_KERNEL);
+  if (!ops)
+    return -ENOMEM;
+
+  if (copy_from_user(ops, (void *)(unsigned long)batch.ops,
+                     batch.count * sizeof(*ops))) {
+    kfree(ops);
+    return -EFAULT;
+  }
+
+  error_code = synccom_port_execute_register_ops(port, ops, batch.count);
+
+  if (error_code == 0 && copy_to_user((void *)(unsigned long)batch.ops, ops,
+                                      batch.count * sizeof(*ops))) {
+    error_code = -EFAULT;
+  }
+
+  kfree(ops);
+
+  return error_code;
+}
+
+/*
+  Blocks like read() until a whole frame is available. Returns 0 with
+  read_semaphore held.
+*/
+static long synccom_wait_for_frame(struct synccom_port *port,
+                                   unsigned flags) {
+  long error_code = 0;
+
+  /* There are no frames to wait for. */
+  if (synccom_port_is_streaming(port))
+    return -EINVAL;
+
+  if (!(flags & SYNCCOM_NOWAIT))
+    synccom_rx_mmap_flush(port);
+
+  if (synccom_rx_mmap_is_mapped(port))
+    return -EBUSY;
+
+  error_code = synccom_down(&port->read_semaphore, flags);
+  if (error_code)
+    return error_code;
+
+  while (!synccom_port_has_incoming_data(port)) {
+    up(&port->read_semaphore);
+
+    if (flags & SYNCCOM_NONBLOCK)
+      return -EAGAIN;
+
+    if (wait_event_interruptible(port->input_queue,
+                                 synccom_port_has_incoming_data(port))) {
+      return -ERESTARTSYS;
+    }
+
+    if (down_interruptible(&port->read_semaphore))
+      return -ERESTARTSYS;
+  }
+
+  return 0;
+}
+
+static long synccom_ioctl_read_frame(struct file *file,
+                                     struct synccom_port *port,
+                                     unsigned long arg) {
+  struct synccom_frame_info info;
+  long error_code = 0;
+
+  if (copy_from_user(&info, (void *)arg, sizeof(info))) {
+    return -EFAULT;
+  }
+
+  error_code = synccom_wait_for_frame(port, synccom_file_flags(file));
+  if (error_code)
+    return error_code;
+
+  error_code = synccom_port_read_frame(port, &info);
+
+  up(&port->read_semaphore);
+
+  if ((error_code == 0 || error_code == -ENOBUFS) &&
+      copy_to_user((void *)arg, &info, sizeof(info))) {
+    return -EFAULT;
+  }
+
+  return error_code;
+}
+
+/*
+  Waits for the first frame like SYNCCOM_READ_FRAME, then reads as many of
+  the frames already received as there are entries, without waiting again.
+  count is set to the number of entries filled in.
+*/
+static long synccom_ioctl_read_frames(struct file *file,
+                                      struct synccom_port *port,
+                                      unsigned long arg) {
+  struct synccom_read_frames frames;
+  struct synccom_frame_info info;
+  struct synccom_frame_info *entry = 0;
+  long error_code = 0;
+  __u32 i = 0;
+
+  if (copy_from_user(&frames, (void *)arg, sizeof(frames))) {
+    return -EFAULT;
+  }
+
+  if (frames.count == 0)
+    return 0;
+
+  error_code = synccom_wait_for_frame(port, synccom_file_flags(file));
+  if (error_code)
+    return error_code;
+
+  entry = (struct synccom_frame_info *)(unsigned long)frames.frames;
+
+  for (i = 0; i < frames.count; i++, entry++) {
+    if (copy_from_user(&info, entry, sizeof(info))) {
+      error_code = -EFAULT;
+      break;
+    }
+
+    error_code = synccom_port_read_frame(port, &info);
+
+    if ((error_code == 0 || (error_code == -ENOBUFS && i == 0)) &&
+        copy_to_user(entry, &info, sizeof(info))) {
+      /* The frame has already been taken off the queue, so this can't just
+         end the batch. */
+      if (error_code == 0) {
+        up(&port->read_semaphore);
+        return -EFAULT;
+      }
+
+      error_code = -EFAULT;
+    }
+
+    if (error_code)
+      break;
+  }
+
+  up(&port->read_semaphore);
+
+  /* Only the first frame's errors count, the rest just end the batch. */
+  if (i == 0)
+    return error_code;
+
+  frames.count = i;
+
+  if (copy_to_user((void *)arg, &frames, sizeof(frames))) {
+    return -EFAULT;
+  }
+
+  return 0;
+}
+
+/* Like write() for every frame at once, they are all queued or none are. */
+static long synccom_ioctl_write_frames(struct file *file,
+                                       struct synccom_port *port,
+                                       unsigned long arg) {
+  struct synccom_write_frames batch;
+  struct synccom_write_frame *frames = 0;
+  size_t total = 0;
+  long error_code = 0;
+  __u32 i = 0;
+
+  if (copy_from_user(&batch, (void *)arg, sizeof(batch))) {
+    return -EFAULT;
+  }
+
+  if (batch.count == 0)
+    return 0;
+
+  if (batch.count > SYNCCOM_MAX_WRITE_FRAMES)
+    return -EINVAL;
+
+  frames = kmalloc_array(batch.count, sizeof(*frames), GFP_KERNEL);
+  if (!frames)
+    return -ENOMEM;
+
+  if (copy_from_user(frames, (void *)(unsigned long)batch.frames,
+                     batch.count * sizeof(*frames))) {
+    kfree(frames);
+    return -EFAULT;
+  }
+
+  for (i = 0; i < batch.count; i++)
+    total += frames[i].length;
+
+  error_code =
+      synccom_wait_for_output_space(port, total, synccom_file_flags(file));
+  if (error_code) {
+    kfree(frames);
+    return error_code;
+  }
+
+  error_code = synccom_port_write_frames(port, frames, batch.count);
+
+  up(&port->write_semaphore);
+
+  kfree(frames);
+
+  return error_code;
+}
+
 long synccom_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
   struct synccom_port *port = 0;
   long error_code = 0;
@@ -257,6 +577,8 @@ long synccom_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
   unsigned int tmp_int = 0;
   struct synccom_registers regs;
   struct synccom_memory_cap tmp_memcap;
+  struct synccom_rx_urbs tmp_rx_urbs;
+  struct synccom_mmap_info mmap_info;
 
   port = file->private_data;
 
@@ -326,7 +648,7 @@ long synccom_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     if (copy_from_user(&tmp_memcap, (void *)arg, sizeof(tmp_memcap))) {
       return -EFAULT;
     }
-    synccom_port_set_memory_cap(port, &tmp_memcap);
+    error_code = synccom_port_set_memory_cap(port, &tmp_memcap);
     break;
 
   case SYNCCOM_GET_MEMORY_CAP:
@@ -342,6 +664,60 @@ long synccom_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     }
     break;
 
+  case SYNCCOM_SET_RX_URBS:
+    if (copy_from_user(&tmp_rx_urbs, (void *)arg, sizeof(tmp_rx_urbs))) {
+      return -EFAULT;
+    }
+    error_code = synccom_port_set_rx_urbs(port, &tmp_rx_urbs);
+    break;
+
+  case SYNCCOM_GET_RX_URBS:
+    synccom_port_get_rx_urbs(port, &tmp_rx_urbs);
+    if (copy_to_user((void *)arg, &tmp_rx_urbs, sizeof(tmp_rx_urbs))) {
+      return -EFAULT;
+    }
+    break;
+
+  case SYNCCOM_REFRESH_REGISTERS:
+    error_code = synccom_port_refresh_registers(port);
+    break;
+
+  case SYNCCOM_REG_BATCH:
+    error_code = synccom_ioctl_register_batch(port, arg);
+    break;
+
+  case SYNCCOM_READ_FRAME:
+    error_code = synccom_ioctl_read_frame(file, port, arg);
+    break;
+
+  case SYNCCOM_READ_FRAMES:
+    error_code = synccom_ioctl_read_frames(file, port, arg);
+    break;
+
+  case SYNCCOM_WRITE_FRAMES:
+    error_code = synccom_ioctl_write_frames(file, port, arg);
+    break;
+
+  case SYNCCOM_GET_RX_RING:
+    error_code = synccom_rx_mmap_get_info(port, &mmap_info);
+    if (error_code == 0 &&
+        copy_to_user((void *)arg, &mmap_info, sizeof(mmap_info))) {
+      return -EFAULT;
+    }
+    break;
+
+  case SYNCCOM_GET_TX_RING:
+    error_code = synccom_tx_mmap_get_info(port, &mmap_info);
+    if (error_code == 0 &&
+        copy_to_user((void *)arg, &mmap_info, sizeof(mmap_info))) {
+      return -EFAULT;
+    }
+    break;
+
+  case SYNCCOM_TX_RING_DOORBELL:
+    synccom_port_kick_oframe_worker(port);
+    break;
+
   case SYNCCOM_SET_CLOCK_BITS:
     if (copy_from_user(clock_bits, (char *)arg, 20)) {
       return -EFAULT;
@@ -419,16 +795,34 @@ long synccom_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
   return error_code;
 }
 
+static int synccom_mmap(struct file *file, struct vm_area_struct *vma) {
+  struct synccom_port *port = 0;
+
+  port = file->private_data;
+
+  if (vma->vm_pgoff == (SYNCCOM_TX_RING_OFFSET >> PAGE_SHIFT))
+    return synccom_tx_mmap_mmap(port, vma);
+
+  return synccom_rx_mmap_mmap(port, vma);
+}
+
 static const struct file_operations synccom_fops = {
     .owner = THIS_MODULE,
-    .read = synccom_read,
-    .write = synccom_write,
+    .read_iter = synccom_read_iter,
+    .write_iter = synccom_write_iter,
+    /* Both fill the pipe's pages through read_iter(), without a user copy. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    .splice_read = copy_splice_read,
+#else
+    .splice_read = generic_file_splice_read,
+#endif
     .open = synccom_open,
     .release = synccom_release,
     .flush = synccom_flush,
     //.llseek =	noop_llseek,
     .unlocked_ioctl = synccom_ioctl,
     .poll = synccom_poll,
+    .mmap = synccom_mmap,
 
 };
 
@@ -513,7 +907,16 @@ static int synccom_probe(struct usb_interface *interface,
   dev_info(port->device, "%s - USB synccom device now attached to synccom%d\n",
            __func__, interface->minor);
 
-  initialize(port);
+  port->rx_urb_count = rx_urbs;
+  port->rx_urb_size = rx_urb_size;
+
+  retval = initialize(port);
+  if (retval) {
+    dev_err(port->device, "%s - Could not initialize the port\n", __func__);
+    usb_deregister_dev(interface, &synccom_class);
+    usb_set_intfdata(interface, NULL);
+    goto error;
+  }
 
   return 0;
 
@@ -545,7 +948,6 @@ static void synccom_disconnect(struct usb_interface *interface) {
   /* decrement our usage count */
   kref_put(&port->kref, synccom_delete);
 
-  del_timer(&port->timer);
   dev_info(port->device, "%s - USB synccom #%d now disconnected", __func__,
            minor);
 }
@@ -600,7 +1002,36 @@ static struct usb_driver synccom_driver = {
     .supports_autosuspend = 1,
 };
 
-module_usb_driver(synccom_driver);
+static int __init synccom_init(void) {
+  int retval = 0;
+
+  synccom_frame_cache = KMEM_CACHE(synccom_frame, 0);
+  if (!synccom_frame_cache)
+    return -ENOMEM;
+
+  synccom_workqueue = alloc_workqueue("synccom", WQ_HIGHPRI | WQ_UNBOUND, 0);
+  if (!synccom_workqueue) {
+    kmem_cache_destroy(synccom_frame_cache);
+    return -ENOMEM;
+  }
+
+  retval = usb_register(&synccom_driver);
+  if (retval) {
+    destroy_workqueue(synccom_workqueue);
+    kmem_cache_destroy(synccom_frame_cache);
+  }
+
+  return retval;
+}
+
+static void __exit synccom_exit(void) {
+  usb_deregister(&synccom_driver);
+  destroy_workqueue(synccom_workqueue);
+  kmem_cache_destroy(synccom_frame_cache);
+}
+
+module_init(synccom_init);
+module_exit(synccom_exit);
 
 MODULE_LICENSE("GPL");
 MODULE_VERSION("1.1.2");
@@ -0,0 +1,704 @@
+/*
+Copyright 2022 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <linux/log2.h>    /* roundup_pow_of_two */
+#include <linux/mm.h>      /* remap_vmalloc_range */
+#include <linux/version.h> /* LINUX_VERSION_CODE, KERNEL_VERSION */
+#include <linux/vmalloc.h> /* vmalloc_user, vfree */
+
+#include "frame.h" /* struct synccom_frame */
+#include "mmap.h"
+#include "port.h"  /* struct synccom_port */
+#include "utils.h" /* return_{val_}if_untrue */
+
+static void synccom_rx_mmap_vm_open(struct vm_area_struct *vma);
+static void synccom_rx_mmap_vm_close(struct vm_area_struct *vma);
+static void synccom_rx_mmap_close_work(struct work_struct *work);
+
+static void synccom_tx_mmap_vm_open(struct vm_area_struct *vma);
+static void synccom_tx_mmap_vm_close(struct vm_area_struct *vma);
+
+static const struct vm_operations_struct synccom_rx_mmap_vm_ops = {
+    .open = synccom_rx_mmap_vm_open,
+    .close = synccom_rx_mmap_vm_close,
+};
+
+static const struct vm_operations_struct synccom_tx_mmap_vm_ops = {
+    .open = synccom_tx_mmap_vm_open,
+    .close = synccom_tx_mmap_vm_close,
+};
+
+void synccom_rx_mmap_init(struct synccom_port *port) {
+  struct synccom_rx_mmap *rx_mmap = &port->rx_mmap;
+
+  rx_mmap->region = 0;
+  rx_mmap->size = 0;
+  rx_mmap->cursor = &port->queued_iframes.frames;
+  atomic_set(&rx_mmap->mappings, 0);
+  atomic_set(&rx_mmap->unmapped, 0);
+  INIT_WORK(&rx_mmap->close_work, synccom_rx_mmap_close_work);
+}
+
+void synccom_rx_mmap_delete(struct synccom_port *port) {
+  return_if_untrue(port);
+
+  /* The last vm_close() can come right before the final reference goes. */
+  flush_work(&port->rx_mmap.close_work);
+
+  vfree(port->rx_mmap.region);
+  port->rx_mmap.region = 0;
+  port->rx_mmap.size = 0;
+}
+
+/*
+  Moves istream into a buffer that can be mapped, unless it is already in
+  one. Called with read_semaphore held.
+*/
+static int synccom_rx_mmap_setup(struct synccom_port *port) {
+  struct synccom_rx_mmap *rx_mmap = &port->rx_mmap;
+  unsigned char *region = 0;
+  unsigned data_offset = 0;
+  unsigned data_size = 0;
+
+  if (rx_mmap->region &&
+      port->istream.buffer == rx_mmap->region + rx_mmap->data_offset)
+    return 0;
+
+  /* The memory cap can't change istream's buffer while it is mapped. */
+  if (synccom_rx_mmap_is_mapped(port))
+    return -EBUSY;
+
+  data_offset = PAGE_ALIGN(sizeof(*rx_mmap->header) +
+                           RX_MMAP_DESC_COUNT * sizeof(*rx_mmap->descs));
+  data_size = synccom_ring_get_size(&port->istream);
+
+  region = vmalloc_user(data_offset + data_size);
+  if (!region) {
+    dev_err(port->device, "%s - not enough memory for %u byte ring\n",
+            __func__, data_offset + data_size);
+    return -ENOMEM;
+  }
+
+  synccom_port_stop_rx(port);
+  synccom_ring_move_buffer(&port->istream, region + data_offset);
+  synccom_port_start_rx(port);
+
+  vfree(rx_mmap->region);
+
+  rx_mmap->region = region;
+  rx_mmap->size = data_offset + data_size;
+  rx_mmap->data_offset = data_offset;
+  rx_mmap->header = (struct synccom_mmap_header *)region;
+  rx_mmap->descs =
+      (struct synccom_rx_desc *)(region + sizeof(*rx_mmap->header));
+
+  return 0;
+}
+
+int synccom_rx_mmap_get_info(struct synccom_port *port,
+                             struct synccom_mmap_info *info) {
+  struct synccom_rx_mmap *rx_mmap = &port->rx_mmap;
+  int error_code = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+
+  /* Streamed data has no frames to describe. */
+  if (synccom_port_is_streaming(port))
+    return -EINVAL;
+
+  if (down_interruptible(&port->read_semaphore))
+    return -ERESTARTSYS;
+
+  error_code = synccom_rx_mmap_setup(port);
+  if (error_code == 0) {
+    memset(info, 0, sizeof(*info));
+    info->size = rx_mmap->size;
+    info->desc_offset = sizeof(*rx_mmap->header);
+    info->desc_count = RX_MMAP_DESC_COUNT;
+    info->data_offset = rx_mmap->data_offset;
+    info->data_size = synccom_ring_get_size(&port->istream);
+  }
+
+  up(&port->read_semaphore);
+
+  return error_code;
+}
+
+/*
+  Gives every frame the application has handed back to the buffer pool, and
+  its data back to istream. Called with rx_spinlock held.
+*/
+static void synccom_rx_mmap_release(struct synccom_port *port) {
+  struct synccom_rx_mmap *rx_mmap = &port->rx_mmap;
+  struct synccom_frame *frame = 0;
+  unsigned count = 0;
+  unsigned bytes = 0;
+
+  count = smp_load_acquire(&rx_mmap->header->tail) - rx_mmap->tail;
+
+  /* Garbage, or a tail from before the last purge. */
+  if (count > rx_mmap->head - rx_mmap->tail)
+    return;
+
+  while (count--) {
+    frame = synccom_flist_remove_frame(&port->queued_iframes);
+    bytes += synccom_frame_get_frame_size(frame);
+
+    if (&frame->list == rx_mmap->cursor)
+      rx_mmap->cursor = &port->queued_iframes.frames;
+
+    synccom_frame_delete(frame);
+    rx_mmap->tail++;
+  }
+
+  synccom_ring_remove_data(&port->istream, NULL, bytes);
+}
+
+/*
+  Fills in a descriptor for every queued frame that has all of its data in
+  istream, as long as there are descriptors left. Called with rx_spinlock
+  held.
+*/
+static unsigned synccom_rx_mmap_publish(struct synccom_port *port) {
+  struct synccom_rx_mmap *rx_mmap = &port->rx_mmap;
+  struct synccom_rx_desc *desc = 0;
+  struct synccom_frame *frame = 0;
+  unsigned char status[2];
+  unsigned frame_size = 0;
+  unsigned published = 0;
+  unsigned data_size = 0;
+  unsigned skip = 0;
+
+  data_size = synccom_ring_get_size(&port->istream);
+
+  while (rx_mmap->head - rx_mmap->tail < RX_MMAP_DESC_COUNT &&
+         rx_mmap->cursor->next != &port->queued_iframes.frames) {
+    frame = list_entry(rx_mmap->cursor->next, struct synccom_frame, list);
+    frame_size = synccom_frame_get_frame_size(frame);
+    skip = rx_mmap->data_head - synccom_ring_get_tail(&port->istream);
+
+    if (skip + frame_size > synccom_ring_get_length(&port->istream))
+      break;
+
+    desc = &rx_mmap->descs[rx_mmap->head & (RX_MMAP_DESC_COUNT - 1)];
+    desc->offset = rx_mmap->data_head & (data_size - 1);
+    desc->length = (frame_size > 2) ? frame_size - 2 : 0;
+
+    memset(status, 0, sizeof(status));
+    synccom_ring_peek_data(&port->istream, skip + desc->length, status,
+                           frame_size - desc->length);
+    desc->status = status[0] | (status[1] << 8);
+    desc->sequence = frame->number;
+    desc->timestamp_sec = frame->timestamp.tv_sec;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0)
+    desc->timestamp_nsec = frame->timestamp.tv_nsec;
+#else
+    desc->timestamp_nsec = frame->timestamp.tv_usec * 1000;
+#endif
+    desc->reserved = 0;
+
+    rx_mmap->data_head += frame_size;
+    rx_mmap->cursor = &frame->list;
+    rx_mmap->head++;
+    published++;
+  }
+
+  /* The descriptors have to be visible before the new head is. */
+  if (published)
+    smp_store_release(&rx_mmap->header->head, rx_mmap->head);
+
+  return published;
+}
+
+/*
+  Releases the frames the application is done with, then publishes what has
+  arrived since. Waiting readers are woken if anything new was published.
+*/
+unsigned synccom_rx_mmap_update(struct synccom_port *port) {
+  unsigned published = 0;
+
+  return_val_if_untrue(port, 0);
+
+  if (!synccom_rx_mmap_is_mapped(port) || synccom_port_is_streaming(port))
+    return 0;
+
+  spin_lock(&port->rx_spinlock);
+  synccom_rx_mmap_release(port);
+  published = synccom_rx_mmap_publish(port);
+  spin_unlock(&port->rx_spinlock);
+
+  if (published)
+    wake_up_interruptible(&port->input_queue);
+
+  return published;
+}
+
+unsigned synccom_rx_mmap_is_mapped(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return atomic_read(&port->rx_mmap.mappings) != 0;
+}
+
+/*
+  Waits for any unmaps that haven't been accounted for yet, so a reader that
+  just unmapped the ring isn't turned away. Can't be called with
+  read_semaphore held.
+*/
+void synccom_rx_mmap_flush(struct synccom_port *port) {
+  return_if_untrue(port);
+
+  if (atomic_read(&port->rx_mmap.unmapped))
+    flush_work(&port->rx_mmap.close_work);
+}
+
+/* Whether there are descriptors the application hasn't handed back. */
+unsigned synccom_rx_mmap_has_frames(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  if (!synccom_rx_mmap_is_mapped(port))
+    return 0;
+
+  return READ_ONCE(port->rx_mmap.header->tail) !=
+         READ_ONCE(port->rx_mmap.head);
+}
+
+/*
+  Forgets the published frames after a purge has thrown them away. Called
+  with rx_spinlock held.
+*/
+void synccom_rx_mmap_purge(struct synccom_port *port) {
+  struct synccom_rx_mmap *rx_mmap = &port->rx_mmap;
+
+  return_if_untrue(port);
+
+  rx_mmap->tail = rx_mmap->head;
+  rx_mmap->cursor = &port->queued_iframes.frames;
+  rx_mmap->data_head = synccom_ring_get_tail(&port->istream);
+}
+
+/*
+  Unpublishes everything so read() sees the frames the application didn't
+  get to. Called with rx_spinlock held.
+*/
+static void synccom_rx_mmap_reset(struct synccom_port *port) {
+  struct synccom_rx_mmap *rx_mmap = &port->rx_mmap;
+
+  rx_mmap->head = rx_mmap->tail;
+  rx_mmap->cursor = &port->queued_iframes.frames;
+  rx_mmap->data_head = synccom_ring_get_tail(&port->istream);
+  smp_store_release(&rx_mmap->header->head, rx_mmap->head);
+}
+
+int synccom_rx_mmap_mmap(struct synccom_port *port,
+                         struct vm_area_struct *vma) {
+  struct synccom_rx_mmap *rx_mmap = &port->rx_mmap;
+  int error_code = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+
+  if (vma->vm_pgoff != (SYNCCOM_RX_RING_OFFSET >> PAGE_SHIFT))
+    return -EINVAL;
+
+  if (synccom_port_is_streaming(port))
+    return -EINVAL;
+
+  /* Keeps read() from running while the frames change hands. mmap_lock is
+     held here and read() can fault while holding read_semaphore, so this
+     can't wait for it. */
+  if (down_trylock(&port->read_semaphore))
+    return -EAGAIN;
+
+  error_code = synccom_rx_mmap_setup(port);
+  if (error_code)
+    goto done;
+
+  if (vma->vm_end - vma->vm_start > rx_mmap->size) {
+    error_code = -EINVAL;
+    goto done;
+  }
+
+  error_code = remap_vmalloc_range(vma, rx_mmap->region, 0);
+  if (error_code)
+    goto done;
+
+  if (!synccom_rx_mmap_is_mapped(port)) {
+    spin_lock(&port->rx_spinlock);
+    rx_mmap->head = 0;
+    rx_mmap->tail = 0;
+    rx_mmap->header->tail = 0;
+    synccom_rx_mmap_reset(port);
+    spin_unlock(&port->rx_spinlock);
+  }
+
+  vma->vm_private_data = port;
+  vma->vm_ops = &synccom_rx_mmap_vm_ops;
+  synccom_rx_mmap_vm_open(vma);
+
+done:
+  up(&port->read_semaphore);
+
+  if (error_code == 0)
+    synccom_rx_mmap_update(port);
+
+  return error_code;
+}
+
+static void synccom_rx_mmap_vm_open(struct vm_area_struct *vma) {
+  struct synccom_port *port = vma->vm_private_data;
+
+  atomic_inc(&port->rx_mmap.mappings);
+}
+
+static void synccom_rx_mmap_vm_close(struct vm_area_struct *vma) {
+  struct synccom_port *port = vma->vm_private_data;
+
+  atomic_inc(&port->rx_mmap.unmapped);
+  schedule_work(&port->rx_mmap.close_work);
+}
+
+/*
+  Hands the frames back to read() once the last mapping is gone. The
+  application's final releases are honored first.
+*/
+static void synccom_rx_mmap_close_work(struct work_struct *work) {
+  struct synccom_rx_mmap *rx_mmap =
+      container_of(work, struct synccom_rx_mmap, close_work);
+  struct synccom_port *port =
+      container_of(rx_mmap, struct synccom_port, rx_mmap);
+  int unmapped = 0;
+
+  down(&port->read_semaphore);
+
+  unmapped = atomic_xchg(&rx_mmap->unmapped, 0);
+
+  if (unmapped && atomic_sub_return(unmapped, &rx_mmap->mappings) == 0) {
+    spin_lock(&port->rx_spinlock);
+    synccom_rx_mmap_release(port);
+    synccom_rx_mmap_reset(port);
+    spin_unlock(&port->rx_spinlock);
+  }
+
+  up(&port->read_semaphore);
+}
+
+void synccom_tx_mmap_init(struct synccom_port *port) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+
+  tx_mmap->region = 0;
+  tx_mmap->size = 0;
+  tx_mmap->header = 0;
+  tx_mmap->tail = 0;
+  atomic_set(&tx_mmap->mappings, 0);
+}
+
+void synccom_tx_mmap_delete(struct synccom_port *port) {
+  return_if_untrue(port);
+
+  vfree(port->tx_mmap.region);
+  port->tx_mmap.region = 0;
+  port->tx_mmap.header = 0;
+  port->tx_mmap.size = 0;
+}
+
+/*
+  Allocates the ring the first time it is asked for, with room for an output
+  memory cap's worth of data. Called with write_semaphore held.
+*/
+static int synccom_tx_mmap_setup(struct synccom_port *port) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+  unsigned char *region = 0;
+  unsigned data_offset = 0;
+  unsigned data_size = 0;
+
+  if (tx_mmap->region)
+    return 0;
+
+  data_offset = PAGE_ALIGN(sizeof(*tx_mmap->header) +
+                           TX_MMAP_DESC_COUNT * sizeof(*tx_mmap->descs));
+  data_size = max_t(unsigned, port->memory_cap.output, TX_AGGREGATE_SIZE);
+  if (data_size > (1U << 30))
+    return -EINVAL;
+
+  data_size = roundup_pow_of_two(data_size);
+
+  region = vmalloc_user(data_offset + data_size);
+  if (!region) {
+    dev_err(port->device, "%s - not enough memory for %u byte ring\n",
+            __func__, data_offset + data_size);
+    return -ENOMEM;
+  }
+
+  tx_mmap->region = region;
+  tx_mmap->size = data_offset + data_size;
+  tx_mmap->data_offset = data_offset;
+  tx_mmap->data_size = data_size;
+  tx_mmap->descs =
+      (struct synccom_tx_desc *)(region + sizeof(*tx_mmap->header));
+  tx_mmap->tail = 0;
+
+  /* The transmit pump looks at the header without taking write_semaphore. */
+  smp_store_release(&tx_mmap->header, (struct synccom_mmap_header *)region);
+
+  return 0;
+}
+
+int synccom_tx_mmap_get_info(struct synccom_port *port,
+                             struct synccom_mmap_info *info) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+  int error_code = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+
+  if (down_interruptible(&port->write_semaphore))
+    return -ERESTARTSYS;
+
+  error_code = synccom_tx_mmap_setup(port);
+  if (error_code == 0) {
+    memset(info, 0, sizeof(*info));
+    info->size = tx_mmap->size;
+    info->desc_offset = sizeof(*tx_mmap->header);
+    info->desc_count = TX_MMAP_DESC_COUNT;
+    info->data_offset = tx_mmap->data_offset;
+    info->data_size = tx_mmap->data_size;
+  }
+
+  up(&port->write_semaphore);
+
+  return error_code;
+}
+
+int synccom_tx_mmap_mmap(struct synccom_port *port,
+                         struct vm_area_struct *vma) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+  int error_code = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+
+  if (vma->vm_pgoff != (SYNCCOM_TX_RING_OFFSET >> PAGE_SHIFT))
+    return -EINVAL;
+
+  if (down_interruptible(&port->write_semaphore))
+    return -ERESTARTSYS;
+
+  error_code = synccom_tx_mmap_setup(port);
+  if (error_code)
+    goto done;
+
+  if (vma->vm_end - vma->vm_start > tx_mmap->size) {
+    error_code = -EINVAL;
+    goto done;
+  }
+
+  error_code = remap_vmalloc_range(vma, tx_mmap->region, 0);
+  if (error_code)
+    goto done;
+
+  vma->vm_private_data = port;
+  vma->vm_ops = &synccom_tx_mmap_vm_ops;
+  synccom_tx_mmap_vm_open(vma);
+
+done:
+  up(&port->write_semaphore);
+
+  return error_code;
+}
+
+static void synccom_tx_mmap_vm_open(struct vm_area_struct *vma) {
+  struct synccom_port *port = vma->vm_private_data;
+
+  atomic_inc(&port->tx_mmap.mappings);
+}
+
+static void synccom_tx_mmap_vm_close(struct vm_area_struct *vma) {
+  struct synccom_port *port = vma->vm_private_data;
+
+  atomic_dec(&port->tx_mmap.mappings);
+}
+
+unsigned synccom_tx_mmap_is_mapped(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return atomic_read(&port->tx_mmap.mappings) != 0;
+}
+
+/*
+  Descriptors filled in by the application but not sent yet. A head more
+  than a ring's worth ahead is garbage and treated like an empty ring.
+*/
+static unsigned synccom_tx_mmap_get_length(struct synccom_port *port) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+  struct synccom_mmap_header *header = 0;
+  unsigned length = 0;
+
+  header = smp_load_acquire(&tx_mmap->header);
+  if (!header)
+    return 0;
+
+  length = smp_load_acquire(&header->head) - READ_ONCE(tx_mmap->tail);
+
+  return (length <= TX_MMAP_DESC_COUNT) ? length : 0;
+}
+
+unsigned synccom_tx_mmap_has_frames(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return synccom_tx_mmap_get_length(port) != 0;
+}
+
+unsigned synccom_tx_mmap_has_space(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return synccom_tx_mmap_get_length(port) < TX_MMAP_DESC_COUNT;
+}
+
+/*
+  Copies the descriptor skip past the next one into desc with tx_modifiers
+  resolved. Descriptors the application filled in wrong are dropped once
+  they are next, until then they end the frames that can be peeked. Called
+  with tx_spinlock held.
+*/
+unsigned synccom_tx_mmap_peek(struct synccom_port *port, unsigned skip,
+                              struct synccom_tx_desc *desc) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+  unsigned index = 0;
+
+  while (synccom_tx_mmap_get_length(port) > skip) {
+    index = tx_mmap->tail + skip;
+    memcpy(desc, &tx_mmap->descs[index & (TX_MMAP_DESC_COUNT - 1)],
+           sizeof(*desc));
+
+    if (desc->tx_modifiers == -1)
+      desc->tx_modifiers = port->tx_modifiers;
+
+    if (desc->length > 0 && desc->length <= tx_mmap->data_size &&
+        synccom_port_is_valid_tx_modifiers(desc->tx_modifiers))
+      return 1;
+
+    if (skip)
+      return 0;
+
+    dev_warn(port->device, "%s - dropping invalid descriptor %u\n",
+             __func__, index);
+    synccom_tx_mmap_consume(port, 1);
+  }
+
+  return 0;
+}
+
+/* Copies the frame desc describes out of the data area. */
+void synccom_tx_mmap_copy(struct synccom_port *port,
+                          struct synccom_tx_desc *desc, unsigned char *dest) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+  unsigned char *data = tx_mmap->region + tx_mmap->data_offset;
+  unsigned offset = 0;
+  unsigned first = 0;
+
+  offset = desc->offset & (tx_mmap->data_size - 1);
+  first = min(desc->length, tx_mmap->data_size - offset);
+
+  memcpy(dest, data + offset, first);
+  memcpy(dest + first, data, desc->length - first);
+}
+
+/*
+  Hands the next count descriptors, and their data, back to the application.
+  Called with tx_spinlock held.
+*/
+void synccom_tx_mmap_consume(struct synccom_port *port, unsigned count) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+
+  tx_mmap->tail += count;
+  smp_store_release(&tx_mmap->header->tail, tx_mmap->tail);
+}
+
+/*
+  Turns the next frame into a synccom_frame if it is bigger than size, for
+  the frames too big to be packed into a transmit URB's buffer. The ring's
+  memory stays put until the port is deleted, so the frame is allocated and
+  filled without tx_spinlock held. It is thrown away if a purge got to the
+  descriptor first.
+*/
+struct synccom_frame *
+synccom_tx_mmap_remove_frame_if_gt(struct synccom_port *port, unsigned size) {
+  struct synccom_tx_desc desc;
+  struct synccom_frame *frame = 0;
+  unsigned char *data = 0;
+  unsigned offset = 0;
+  unsigned found = 0;
+  unsigned first = 0;
+  unsigned tail = 0;
+
+  spin_lock(&port->tx_spinlock);
+  found = synccom_tx_mmap_peek(port, 0, &desc);
+  tail = port->tx_mmap.tail;
+  spin_unlock(&port->tx_spinlock);
+
+  if (!found || desc.length <= size)
+    return 0;
+
+  frame = synccom_frame_new(port, GFP_KERNEL);
+  if (!frame)
+    return 0;
+
+  data = port->tx_mmap.region + port->tx_mmap.data_offset;
+  offset = desc.offset & (port->tx_mmap.data_size - 1);
+  first = min(desc.length, port->tx_mmap.data_size - offset);
+
+  if (!synccom_frame_add_data(frame, data + offset, first) ||
+      (desc.length > first &&
+       !synccom_frame_add_data(frame, data, desc.length - first))) {
+    synccom_frame_delete(frame);
+    return 0;
+  }
+
+  frame->frame_size = desc.length;
+  frame->tx_modifiers = desc.tx_modifiers;
+
+  spin_lock(&port->tx_spinlock);
+  if (port->tx_mmap.tail == tail)
+    synccom_tx_mmap_consume(port, 1);
+  else
+    found = 0;
+  spin_unlock(&port->tx_spinlock);
+
+  if (!found) {
+    synccom_frame_delete(frame);
+    return 0;
+  }
+
+  frame->number = atomic_inc_return(&port->tx_sequence);
+
+  return frame;
+}
+
+/* Drops every frame not sent yet. Called with tx_spinlock held. */
+void synccom_tx_mmap_purge(struct synccom_port *port) {
+  struct synccom_tx_mmap *tx_mmap = &port->tx_mmap;
+
+  return_if_untrue(port);
+
+  if (!tx_mmap->header)
+    return;
+
+  tx_mmap->tail += synccom_tx_mmap_get_length(port);
+  smp_store_release(&tx_mmap->header->tail, tx_mmap->tail);
+}
@@ -0,0 +1,112 @@
+/*
+Copyright 2022 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SYNCCOM_MMAP_H
+#define SYNCCOM_MMAP_H
+
+#include <linux/list.h>      /* struct list_head */
+#include <linux/mm.h>        /* struct vm_area_struct */
+#include <linux/workqueue.h> /* struct work_struct */
+
+#include "synccom.h" /* struct synccom_mmap_header, struct synccom_rx_desc */
+
+struct synccom_port;
+
+#define RX_MMAP_DESC_COUNT 1024
+#define TX_MMAP_DESC_COUNT 1024
+
+/*
+  Receive ring shared with the application through mmap(). The mapping is a
+  header page, the descriptors, then istream's buffer itself, so frame data
+  is never copied once it has been received.
+
+  Frames stay queued in queued_iframes (and their data in istream) until the
+  application hands their descriptors back, everything up to cursor has been
+  published. All of it is protected by rx_spinlock.
+
+  mappings only changes under read_semaphore, so read() never sees the ring
+  change hands halfway through. vm_close() runs under mmap_lock and read()
+  can fault while holding read_semaphore, so unmaps are only counted in
+  unmapped there and accounted for later by close_work.
+*/
+struct synccom_rx_mmap {
+  unsigned char *region;
+  unsigned size;
+  unsigned data_offset;
+  struct synccom_mmap_header *header;
+  struct synccom_rx_desc *descs;
+  unsigned head;            /* Descriptors published */
+  unsigned tail;            /* Descriptors handed back and released */
+  unsigned data_head;       /* Where istream's unpublished data starts */
+  struct list_head *cursor; /* Last published frame, or queued_iframes' head */
+  atomic_t mappings;
+  atomic_t unmapped; /* vm_close()s close_work hasn't accounted for yet */
+  struct work_struct close_work;
+};
+
+/*
+  Transmit ring shared with the application through mmap(), laid out like
+  the receive ring. The application fills in descriptors and frame data and
+  moves head, the transmit pump packs the frames straight into its URB
+  buffers and moves tail. Unlike the receive ring it doesn't go away when
+  unmapped. tail is protected by tx_spinlock.
+*/
+struct synccom_tx_mmap {
+  unsigned char *region;
+  unsigned size;
+  unsigned data_offset;
+  unsigned data_size;
+  struct synccom_mmap_header *header;
+  struct synccom_tx_desc *descs;
+  unsigned tail; /* Descriptors sent */
+  atomic_t mappings;
+};
+
+void synccom_rx_mmap_init(struct synccom_port *port);
+void synccom_rx_mmap_delete(struct synccom_port *port);
+int synccom_rx_mmap_get_info(struct synccom_port *port,
+                             struct synccom_mmap_info *info);
+int synccom_rx_mmap_mmap(struct synccom_port *port, struct vm_area_struct *vma);
+unsigned synccom_rx_mmap_is_mapped(struct synccom_port *port);
+void synccom_rx_mmap_flush(struct synccom_port *port);
+unsigned synccom_rx_mmap_update(struct synccom_port *port);
+unsigned synccom_rx_mmap_has_frames(struct synccom_port *port);
+void synccom_rx_mmap_purge(struct synccom_port *port);
+
+void synccom_tx_mmap_init(struct synccom_port *port);
+void synccom_tx_mmap_delete(struct synccom_port *port);
+int synccom_tx_mmap_get_info(struct synccom_port *port,
+                             struct synccom_mmap_info *info);
+int synccom_tx_mmap_mmap(struct synccom_port *port, struct vm_area_struct *vma);
+unsigned synccom_tx_mmap_is_mapped(struct synccom_port *port);
+unsigned synccom_tx_mmap_has_frames(struct synccom_port *port);
+unsigned synccom_tx_mmap_has_space(struct synccom_port *port);
+unsigned synccom_tx_mmap_peek(struct synccom_port *port, unsigned skip,
+                              struct synccom_tx_desc *desc);
+void synccom_tx_mmap_copy(struct synccom_port *port,
+                          struct synccom_tx_desc *desc, unsigned char *dest);
+void synccom_tx_mmap_consume(struct synccom_port *port, unsigned count);
+struct synccom_frame *synccom_tx_mmap_remove_frame_if_gt(
+    struct synccom_port *port, unsigned size);
+void synccom_tx_mmap_purge(struct synccom_port *port);
+
+#endif
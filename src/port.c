@@ -21,6 +21,7 @@ THE SOFTWARE.
 */
 
 #include <linux/uaccess.h> /* copy_*_user in <= 2.6.24 */
+#include <linux/uio.h>     /* copy_to_iter, iov_iter_count */
 #include <linux/version.h> /* LINUX_VERSION_CODE, KERNEL_VERSION */
 #include <linux/workqueue.h>
 
@@ -35,18 +36,24 @@ void synccom_port_execute_STOP_R(struct synccom_port *port);
 void synccom_port_execute_STOP_T(struct synccom_port *port);
 void synccom_port_execute_RST_R(struct synccom_port *port);
 static void read_data_callback(struct urb *urb);
+static void write_data_callback(struct urb *urb);
 void frame_count_worker(struct work_struct *port);
+static enum hrtimer_restart rx_watermark_timer_handler(struct hrtimer *timer);
 unsigned synccom_port_timed_out(struct synccom_port *port, int need_lock);
-ssize_t synccom_port_stream_read(struct synccom_port *port, char *buf, size_t length);
-ssize_t synccom_port_frame_read(struct synccom_port *port, char *buf, size_t length);
-int synccom_port_write_data(struct synccom_port *port, char *data, unsigned byte_count);
-void synccom_port_set_clock(struct synccom_port *port, unsigned bar, unsigned register_offset, char *data, unsigned byte_count);
+ssize_t synccom_port_stream_read(struct synccom_port *port,
+                                 struct iov_iter *to);
+ssize_t synccom_port_frame_read(struct synccom_port *port,
+                                struct iov_iter *to);
+int synccom_port_write_frame(struct synccom_port *port, struct synccom_frame *frame);
 __u16 synccom_port_get_PDEV(struct synccom_port *port);
 unsigned synccom_port_get_CE(struct synccom_port *port);
 int prepare_frame_for_fifo(struct synccom_port *port, struct synccom_frame *frame, unsigned *length);
 
+/*
+  Everything that can't fail is set up first, so synccom_delete can tear the
+  port down no matter where this bails out.
+*/
 int initialize(struct synccom_port *port) {
-  int i;
   char clock_bits[20] = DEFAULT_CLOCK_BITS;
 
   port->device = &port->udev->dev;
@@ -55,29 +62,58 @@ int initialize(struct synccom_port *port) {
 
   sema_init(&port->write_semaphore, 1);
   sema_init(&port->read_semaphore, 1);
-  sema_init(&port->poll_semaphore, 1);
 
   init_waitqueue_head(&port->input_queue);
   init_waitqueue_head(&port->output_queue);
 
+  spin_lock_init(&port->rx_spinlock);
+  spin_lock_init(&port->tx_spinlock);
+
+  INIT_LIST_HEAD(&port->list);
+  synccom_flist_init(&port->queued_oframes);
+  synccom_flist_init(&port->queued_iframes);
+  synccom_rx_mmap_init(port);
+  synccom_tx_mmap_init(port);
+  port->pending_oframe = 0;
+
+  atomic_set(&port->bclist_pending_bytes, 0);
+  atomic_set(&port->output_memory_usage, 0);
+  atomic_set(&port->rx_sequence, 0);
+  atomic_set(&port->tx_sequence, 0);
+  INIT_DELAYED_WORK(&port->bclist_worker, frame_count_worker);
+
+  INIT_DELAYED_WORK(&port->send_oframe_worker, oframe_worker);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 15, 0)
+  hrtimer_setup(&port->rx_watermark_timer, rx_watermark_timer_handler,
+                CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+  hrtimer_init(&port->rx_watermark_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+  port->rx_watermark_timer.function = rx_watermark_timer_handler;
+#endif
+
+  synccom_frame_buffers_init(port);
+  port->initialized = 1;
+
   port->memory_cap.input = DEFAULT_INPUT_MEMORY_CAP_VALUE;
   port->memory_cap.output = DEFAULT_OUTPUT_MEMORY_CAP_VALUE;
 
-  spin_lock_init(&port->board_rx_spinlock);
-  spin_lock_init(&port->board_tx_spinlock);
-
-  spin_lock_init(&port->istream_spinlock);
-  spin_lock_init(&port->pending_iframe_spinlock);
-  spin_lock_init(&port->pending_oframe_spinlock);
+  if (synccom_transaction_pool_init(port) != 0)
+    return -ENOMEM;
 
-  spin_lock_init(&port->queued_oframes_spinlock);
-  spin_lock_init(&port->queued_iframes_spinlock);
-  spin_lock_init(&port->pending_iframes_spinlock);
+  if (!synccom_ring_init(&port->istream, port, port->memory_cap.input))
+    return -ENOMEM;
 
   synccom_port_set_append_status(port, DEFAULT_APPEND_STATUS_VALUE);
   synccom_port_set_ignore_timeout(port, DEFAULT_IGNORE_TIMEOUT_VALUE);
   synccom_port_set_tx_modifiers(port, DEFAULT_TX_MODIFIERS_VALUE);
   synccom_port_set_rx_multiple(port, DEFAULT_RX_MULTIPLE_VALUE);
+  synccom_port_set_rx_coalesce_bytes(port, DEFAULT_RX_COALESCE_BYTES_VALUE);
+  synccom_port_set_rx_coalesce_usecs(port, DEFAULT_RX_COALESCE_USECS_VALUE);
+  synccom_port_set_rx_watermark_bytes(port, DEFAULT_RX_WATERMARK_BYTES_VALUE);
+  synccom_port_set_rx_watermark_usecs(port, DEFAULT_RX_WATERMARK_USECS_VALUE);
+  synccom_port_set_tx_aggregate_bytes(port, DEFAULT_TX_AGGREGATE_BYTES_VALUE);
+  synccom_port_set_tx_aggregate_usecs(port, DEFAULT_TX_AGGREGATE_USECS_VALUE);
 
   SYNCCOM_REGISTERS_INIT(port->register_storage);
   port->register_storage.FIFOT = DEFAULT_FIFOT_VALUE;
@@ -99,87 +135,325 @@ int initialize(struct synccom_port *port) {
   synccom_port_set_registers(port, &port->register_storage);
   synccom_port_set_clock_bits(port, clock_bits);
 
-  synccom_port_create_urbs(port);
-
-  INIT_LIST_HEAD(&port->list);
-  synccom_flist_init(&port->queued_oframes);
-  synccom_flist_init(&port->queued_iframes);
-  synccom_flist_init(&port->pending_iframes);
-  port->istream = synccom_frame_new(port);
-  port->pending_iframe = 0;
-  port->pending_oframe = 0;
-
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0)
-  init_timer(&port->timer);
-  port->timer.data = (unsigned long)port;
-  port->timer.function = &timer_handler;
-#else
-  timer_setup(&port->timer, &timer_handler, 0);
-#endif
-
-  INIT_WORK(&port->bclist_worker, frame_count_worker);
+  if (synccom_port_create_urbs(port) != 0)
+    return -ENOMEM;
 
-  tasklet_init(&port->send_oframe_tasklet, oframe_worker, (unsigned long)port);
+  if (synccom_port_create_tx_urbs(port) != 0)
+    return -ENOMEM;
 
   synccom_port_execute_RRES(port, 1);
   synccom_port_execute_TRES(port, 1);
 
-  mod_timer(&port->timer, jiffies + msecs_to_jiffies(20));
-
-  for (i = 0; i < NUMBER_OF_URBS; i++) {
-    usb_submit_urb(port->bulk_in_urbs[i], GFP_ATOMIC);
-  }
+  synccom_port_start_rx(port);
   port->fx2_rev = synccom_port_get_fx2(port, 1);
   return 0;
 }
 
+/* Transfer sizes have to be whole packets so every record starts a packet. */
+static unsigned synccom_port_round_rx_urb_size(struct synccom_port *port,
+                                               unsigned size) {
+  unsigned max_size = MAX_RX_URB_SIZE - (MAX_RX_URB_SIZE % port->rx_packet_size);
+
+  size = roundup(size, port->rx_packet_size);
+
+  return clamp(size, port->rx_packet_size, max_size);
+}
+
 int synccom_port_create_urbs(struct synccom_port *port) {
-  int i, buffer_size;
-  buffer_size = URB_BUFFER_SIZE * sizeof(unsigned char);
+  struct usb_host_endpoint *endpoint = 0;
+  unsigned pipe = 0;
+  int i;
+
+  pipe = usb_rcvbulkpipe(port->udev, DATA_READ_ENDPOINT);
+  endpoint = usb_pipe_endpoint(port->udev, pipe);
+
+  port->rx_packet_size = (endpoint) ? usb_endpoint_maxp(&endpoint->desc) : 0;
+  if (port->rx_packet_size == 0)
+    port->rx_packet_size = DEFAULT_RX_URB_SIZE;
+
+  port->rx_urb_count = clamp(port->rx_urb_count, 1U, (unsigned)MAX_RX_URB_COUNT);
+  port->rx_urb_size = synccom_port_round_rx_urb_size(port, port->rx_urb_size);
 
   // read urbs
   port->bulk_in_urbs =
-      kmalloc(NUMBER_OF_URBS * sizeof(struct urb *), GFP_KERNEL);
+      kcalloc(port->rx_urb_count, sizeof(struct urb *), GFP_KERNEL);
   port->bulk_in_buffers =
-      kmalloc(NUMBER_OF_URBS * sizeof(unsigned char *), GFP_KERNEL);
+      kcalloc(port->rx_urb_count, sizeof(unsigned char *), GFP_KERNEL);
+
+  if (!port->bulk_in_urbs || !port->bulk_in_buffers)
+    goto error;
 
-  for (i = 0; i < NUMBER_OF_URBS; i++) {
+  for (i = 0; i < port->rx_urb_count; i++) {
     port->bulk_in_urbs[i] = usb_alloc_urb(0, GFP_KERNEL);
-    port->bulk_in_buffers[i] = kmalloc(buffer_size, GFP_KERNEL);
-    usb_fill_bulk_urb(
-        port->bulk_in_urbs[i], port->udev, usb_rcvbulkpipe(port->udev, 0x82),
-        port->bulk_in_buffers[i], buffer_size, read_data_callback, port);
+    if (!port->bulk_in_urbs[i])
+      goto error;
+
+    /* The buffers stay mapped for the life of the urbs instead of being
+       mapped and unmapped on every submission. */
+    port->bulk_in_buffers[i] =
+        usb_alloc_coherent(port->udev, port->rx_urb_size, GFP_KERNEL,
+                           &port->bulk_in_urbs[i]->transfer_dma);
+    if (!port->bulk_in_buffers[i])
+      goto error;
+
+    usb_fill_bulk_urb(port->bulk_in_urbs[i], port->udev, pipe,
+                      port->bulk_in_buffers[i], port->rx_urb_size,
+                      read_data_callback, port);
+    port->bulk_in_urbs[i]->transfer_flags |= URB_NO_TRANSFER_DMA_MAP;
   }
 
+  dev_dbg(port->device, "%u receive urbs of %u bytes (%u byte packets)\n",
+          port->rx_urb_count, port->rx_urb_size, port->rx_packet_size);
+
   return 0;
+
+error:
+  dev_err(port->device, "%s - not enough memory for %u receive urbs\n",
+          __func__, port->rx_urb_count);
+  synccom_port_destroy_urbs(port);
+
+  return -ENOMEM;
 }
 
 int synccom_port_destroy_urbs(struct synccom_port *port) {
   int i;
 
+  if (!port->bulk_in_urbs || !port->bulk_in_buffers) {
+    kfree(port->bulk_in_urbs);
+    kfree(port->bulk_in_buffers);
+    port->bulk_in_urbs = 0;
+    port->bulk_in_buffers = 0;
+    return 0;
+  }
+
   // read urbs
-  for (i = 0; i < NUMBER_OF_URBS; i++) {
+  for (i = 0; i < port->rx_urb_count; i++) {
+    if (port->bulk_in_buffers[i])
+      usb_free_coherent(port->udev, port->rx_urb_size,
+                        port->bulk_in_buffers[i],
+                        port->bulk_in_urbs[i]->transfer_dma);
     usb_free_urb(port->bulk_in_urbs[i]);
-    kfree(port->bulk_in_buffers[i]);
   }
 
   kfree(port->bulk_in_urbs);
   kfree(port->bulk_in_buffers);
+  port->bulk_in_urbs = 0;
+  port->bulk_in_buffers = 0;
+
+  return 0;
+}
+
+/*
+  A single frame is sent straight from its own buffer, so tx_buffers are only
+  used to pack several frames together when aggregation is turned on.
+*/
+int synccom_port_create_tx_urbs(struct synccom_port *port) {
+  int i;
+
+  port->tx_urbs_busy = 0;
+
+  for (i = 0; i < WRITES_IN_FLIGHT; i++) {
+    port->tx_frames[i] = 0;
+    port->tx_urbs[i] = usb_alloc_urb(0, GFP_KERNEL);
+    port->tx_buffers[i] = kmalloc(TX_AGGREGATE_SIZE, GFP_KERNEL);
+    if (!port->tx_urbs[i] || !port->tx_buffers[i]) {
+      dev_err(port->device, "%s: Couldn't alloc urb!", __func__);
+      synccom_port_destroy_tx_urbs(port);
+      return -ENOMEM;
+    }
+  }
 
   return 0;
 }
 
+void synccom_port_destroy_tx_urbs(struct synccom_port *port) {
+  int i;
+
+  for (i = 0; i < WRITES_IN_FLIGHT; i++) {
+    if (port->tx_urbs[i])
+      usb_kill_urb(port->tx_urbs[i]);
+
+    usb_free_urb(port->tx_urbs[i]);
+    port->tx_urbs[i] = 0;
+
+    kfree(port->tx_buffers[i]);
+    port->tx_buffers[i] = 0;
+  }
+}
+
+/*
+  Returns the index of a free transmit URB, or -EBUSY if WRITES_IN_FLIGHT are
+  already out.
+*/
+static int synccom_port_get_tx_urb(struct synccom_port *port) {
+  int i;
+
+  if (down_trylock(&port->limit_sem))
+    return -EBUSY;
+
+  for (i = 0; i < WRITES_IN_FLIGHT; i++) {
+    if (port->tx_urbs[i] && !test_and_set_bit(i, &port->tx_urbs_busy))
+      return i;
+  }
+
+  up(&port->limit_sem);
+
+  return -EBUSY;
+}
+
+/* Frees the frame the URB was carrying, if any, and returns it to the pool. */
+static void synccom_port_put_tx_urb(struct synccom_port *port,
+                                    struct urb *urb) {
+  int i;
+
+  for (i = 0; i < WRITES_IN_FLIGHT; i++) {
+    if (port->tx_urbs[i] == urb) {
+      if (port->tx_frames[i]) {
+        synccom_frame_delete(port->tx_frames[i]);
+        port->tx_frames[i] = 0;
+      }
+
+      clear_bit(i, &port->tx_urbs_busy);
+      up(&port->limit_sem);
+      return;
+    }
+  }
+}
+
+/* Submits tx_urbs[i] to the data endpoint, returning it on failure. */
+static int synccom_port_submit_tx_urb(struct synccom_port *port, int i,
+                                      void *buffer, unsigned byte_count) {
+  struct urb *write_urb = port->tx_urbs[i];
+  int result = 0;
+
+  dev_dbg(port->device, "Attempting to write %d bytes.", byte_count);
+  usb_fill_bulk_urb(write_urb, port->udev, usb_sndbulkpipe(port->udev, 6),
+                    buffer, byte_count, write_data_callback, port);
+  usb_anchor_urb(write_urb, &port->submitted);
+
+  result = usb_submit_urb(write_urb, GFP_ATOMIC);
+  if (result) {
+    usb_unanchor_urb(write_urb);
+    port->tx_frames[i] = 0; /* still the caller's */
+    synccom_port_put_tx_urb(port, write_urb);
+  }
+
+  return result;
+}
+
+/*
+  Runs the transmit pump right away when aggregation is off or enough data is
+  waiting, otherwise within tx_aggregate_usecs of the first queued frame.
+*/
+void synccom_port_kick_oframe_worker(struct synccom_port *port) {
+  if (port->tx_aggregate_bytes == 0 || port->tx_aggregate_usecs == 0 ||
+      atomic_read(&port->output_memory_usage) >= port->tx_aggregate_bytes) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 7, 0)
+    mod_delayed_work(synccom_workqueue, &port->send_oframe_worker, 0);
+#else
+    queue_delayed_work(synccom_workqueue, &port->send_oframe_worker, 0);
+#endif
+    return;
+  }
+
+  /* Does nothing if the worker is already waiting to run. */
+  queue_delayed_work(synccom_workqueue, &port->send_oframe_worker,
+                     usecs_to_jiffies(port->tx_aggregate_usecs));
+}
+
+static enum hrtimer_restart rx_watermark_timer_handler(struct hrtimer *timer) {
+  struct synccom_port *port =
+      container_of(timer, struct synccom_port, rx_watermark_timer);
+
+  wake_up_interruptible(&port->input_queue);
+
+  return HRTIMER_NORESTART;
+}
+
+/*
+  Called for every URB worth of streaming data. Waiting readers are woken
+  once rx_watermark_bytes are waiting, or rx_watermark_usecs after the data
+  that started the timer arrived, instead of for every transfer.
+*/
+static void synccom_port_kick_stream_readers(struct synccom_port *port) {
+  if (port->rx_watermark_bytes == 0 || port->rx_watermark_usecs == 0 ||
+      synccom_ring_get_length(&port->istream) >= port->rx_watermark_bytes) {
+    hrtimer_try_to_cancel(&port->rx_watermark_timer);
+    wake_up_interruptible(&port->input_queue);
+    return;
+  }
+
+  /* Don't push back the deadline of data that is already waiting. */
+  if (!hrtimer_active(&port->rx_watermark_timer))
+    hrtimer_start(&port->rx_watermark_timer,
+                  ns_to_ktime((u64)port->rx_watermark_usecs * NSEC_PER_USEC),
+                  HRTIMER_MODE_REL);
+}
+
+void synccom_port_start_rx(struct synccom_port *port) {
+  int i;
+
+  if (!port->bulk_in_urbs)
+    return;
+
+  for (i = 0; i < port->rx_urb_count; i++) {
+    usb_submit_urb(port->bulk_in_urbs[i], GFP_KERNEL);
+  }
+}
+
+/* Once this returns read_data_callback() won't run until synccom_port_start_rx(). */
+void synccom_port_stop_rx(struct synccom_port *port) {
+  int i;
+
+  if (!port->bulk_in_urbs)
+    return;
+
+  for (i = 0; i < port->rx_urb_count; i++) {
+    usb_kill_urb(port->bulk_in_urbs[i]);
+  }
+}
+
 void frame_count_worker(struct work_struct *port) {
   struct synccom_port *sport =
-      container_of(port, struct synccom_port, bclist_worker);
+      container_of(to_delayed_work(port), struct synccom_port, bclist_worker);
+
+  atomic_set(&sport->bclist_pending_bytes, 0);
   update_bc_buffer(sport);
+  synccom_rx_mmap_update(sport);
 }
 
-void synccom_port_reset_timer(struct synccom_port *port) {
-  if (mod_timer(&port->timer, jiffies + msecs_to_jiffies(1)))
-    dev_err(port->device, "mod_timer\n");
+static void synccom_port_run_bclist_worker(struct synccom_port *port) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 7, 0)
+  mod_delayed_work(synccom_workqueue, &port->bclist_worker, 0);
+#else
+  queue_delayed_work(synccom_workqueue, &port->bclist_worker, 0);
+#endif
 }
 
+/*
+  Called for every URB worth of frame mode data. The frame lengths are only
+  fetched once enough data has arrived or the coalescing delay runs out,
+  unless the reader has nothing left to consume in which case it happens
+  right away.
+*/
+static void synccom_port_kick_bclist_worker(struct synccom_port *port,
+                                            unsigned received) {
+  unsigned pending = 0;
+
+  pending = atomic_add_return(received, &port->bclist_pending_bytes);
+
+  if (port->rx_coalesce_usecs == 0 || pending >= port->rx_coalesce_bytes ||
+      synccom_flist_is_empty(&port->queued_iframes)) {
+    synccom_port_run_bclist_worker(port);
+    return;
+  }
+
+  /* Does nothing if the worker is already waiting to run. */
+  queue_delayed_work(synccom_workqueue, &port->bclist_worker,
+                     usecs_to_jiffies(port->rx_coalesce_usecs));
+}
+
+/* Waits for the card to finish executing the last command (CE to clear). */
 unsigned synccom_port_timed_out(struct synccom_port *port, int need_lock) {
   __u32 star_value = 0;
   unsigned i = 0;
@@ -196,54 +470,140 @@ unsigned synccom_port_timed_out(struct synccom_port *port, int need_lock) {
   return 1;
 }
 
-int synccom_port_write(struct synccom_port *port, const char *data,
-                       unsigned length) {
-  unsigned long queued_flags = 0;
+static struct synccom_frame *synccom_port_new_oframe(struct synccom_port *port,
+                                                     const char *data,
+                                                     unsigned length,
+                                                     int tx_modifiers) {
+  struct synccom_frame *frame = 0;
+
+  frame = synccom_frame_new(port, GFP_KERNEL);
+  if (!frame)
+    return 0;
+
+  if (!synccom_frame_add_data_from_user(frame, data, length)) {
+    synccom_frame_delete(frame);
+    return 0;
+  }
+
+  frame->frame_size = length;
+  frame->tx_modifiers = tx_modifiers;
+
+  return frame;
+}
+
+int synccom_port_write(struct synccom_port *port, struct iov_iter *from,
+                       gfp_t malloc_flags) {
   struct synccom_frame *frame = 0;
+  unsigned length = 0;
+  int error_code = 0;
 
   return_val_if_untrue(port, 0);
 
-  frame = synccom_frame_new(port);
+  length = iov_iter_count(from);
+
+  frame = synccom_frame_new(port, malloc_flags);
   if (!frame)
     return -ENOMEM;
 
-  synccom_frame_add_data_from_user(frame, data, length);
+  if (!synccom_frame_add_data_from_iter(frame, from, length, malloc_flags)) {
+    /* A buffer that is still too small means the allocation failed. */
+    error_code =
+        (synccom_frame_get_buffer_size(frame) < length) ? -ENOMEM : -EFAULT;
+    synccom_frame_delete(frame);
+    return error_code;
+  }
+
   frame->frame_size = length;
+  frame->tx_modifiers = port->tx_modifiers;
 
-  spin_lock_irqsave(&port->queued_oframes_spinlock, queued_flags);
+  frame->number = atomic_inc_return(&port->tx_sequence);
+
+  atomic_add(synccom_frame_get_length(frame), &port->output_memory_usage);
+
+  spin_lock(&port->tx_spinlock);
   synccom_flist_add_frame(&port->queued_oframes, frame);
-  spin_unlock_irqrestore(&port->queued_oframes_spinlock, queued_flags);
+  spin_unlock(&port->tx_spinlock);
+
+  synccom_port_kick_oframe_worker(port);
+
+  return 0;
+}
+
+/*
+  Queues all of the frames or none of them. Every frame is copied in before
+  any of them is queued, and then they are all queued at once.
+*/
+int synccom_port_write_frames(struct synccom_port *port,
+                              const struct synccom_write_frame *frames,
+                              unsigned count) {
+  struct synccom_flist oframes;
+  struct synccom_frame *frame = 0;
+  unsigned i = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+
+  for (i = 0; i < count; i++) {
+    if (frames[i].length == 0 ||
+        (frames[i].tx_modifiers != -1 &&
+         !synccom_port_is_valid_tx_modifiers(frames[i].tx_modifiers)))
+      return -EINVAL;
+  }
+
+  synccom_flist_init(&oframes);
+
+  for (i = 0; i < count; i++) {
+    frame = synccom_port_new_oframe(
+        port, (const char *)(unsigned long)frames[i].buffer, frames[i].length,
+        (frames[i].tx_modifiers == -1) ? port->tx_modifiers
+                                       : frames[i].tx_modifiers);
+    if (!frame) {
+      synccom_flist_clear(&oframes);
+      return -EFAULT;
+    }
 
-  tasklet_schedule(&port->send_oframe_tasklet);
+    synccom_flist_add_frame(&oframes, frame);
+  }
+
+  list_for_each_entry(frame, &oframes.frames, list) {
+    frame->number = atomic_inc_return(&port->tx_sequence);
+  }
+
+  atomic_add(synccom_flist_calculate_memory_usage(&oframes),
+             &port->output_memory_usage);
+
+  spin_lock(&port->tx_spinlock);
+  synccom_flist_splice(&port->queued_oframes, &oframes);
+  spin_unlock(&port->tx_spinlock);
+
+  synccom_port_kick_oframe_worker(port);
 
   return 0;
 }
 
-ssize_t synccom_port_stream_read(struct synccom_port *port, char *buf,
-                                 size_t length) {
+ssize_t synccom_port_stream_read(struct synccom_port *port,
+                                 struct iov_iter *to) {
   unsigned out_length = 0;
-  unsigned long istream_flags = 0;
 
-  spin_lock_irqsave(&port->istream_spinlock, istream_flags);
-  out_length = min(length, (size_t)synccom_frame_get_length(port->istream));
-  synccom_frame_remove_data(port->istream, buf, out_length);
-  spin_unlock_irqrestore(&port->istream_spinlock, istream_flags);
+  out_length = min(iov_iter_count(to),
+                   (size_t)synccom_ring_get_length(&port->istream));
+  if (!synccom_ring_remove_data_iter(&port->istream, to, out_length))
+    return -EFAULT;
 
   return out_length;
 }
 
-ssize_t synccom_port_frame_read(struct synccom_port *port, char *buf,
-                                size_t buf_length) {
+ssize_t synccom_port_frame_read(struct synccom_port *port,
+                                struct iov_iter *to) {
   struct synccom_frame *frame = 0;
   unsigned remaining_buf_length = 0;
   int max_frame_length = 0;
   unsigned current_frame_length = 0;
   unsigned stream_length = 0;
   unsigned out_length = 0;
-  unsigned long queued_flags = 0;
+  ssize_t error_code = -ENOBUFS;
 
   do {
-    remaining_buf_length = buf_length - out_length;
+    remaining_buf_length = iov_iter_count(to);
 
     if (port->append_status && port->append_timestamp)
       max_frame_length = remaining_buf_length - sizeof(synccom_timestamp);
@@ -257,32 +617,40 @@ ssize_t synccom_port_frame_read(struct synccom_port *port, char *buf,
     if (max_frame_length < 0)
       break;
 
-    spin_lock_irqsave(&port->queued_iframes_spinlock, queued_flags);
+    spin_lock(&port->rx_spinlock);
     frame = synccom_flist_peek_front(&port->queued_iframes);
     if(!frame) {
-        spin_unlock_irqrestore(&port->queued_iframes_spinlock, queued_flags);
+        spin_unlock(&port->rx_spinlock);
         break;
     }
     current_frame_length = synccom_frame_get_frame_size(frame);
-    stream_length = synccom_frame_get_length(port->istream);
+    stream_length = synccom_ring_get_length(&port->istream);
     if((current_frame_length > max_frame_length) || (stream_length < current_frame_length)) {
-        spin_unlock_irqrestore(&port->queued_iframes_spinlock, queued_flags);
+        spin_unlock(&port->rx_spinlock);
         break;
     }
-    frame = synccom_flist_remove_frame(&port->queued_iframes);
-    spin_unlock_irqrestore(&port->queued_iframes_spinlock, queued_flags);
+    spin_unlock(&port->rx_spinlock);
 
+    /* The frame stays queued until its data is out, so a failed copy leaves
+       the frames and istream lined up. */
     current_frame_length -= (!port->append_status) ? 2 : 0;
-    spin_lock_irqsave(&port->istream_spinlock, queued_flags);
-    synccom_frame_remove_data(port->istream, buf + out_length, current_frame_length);
+    if (!synccom_ring_remove_data_iter(&port->istream, to,
+                                       current_frame_length)) {
+      error_code = -EFAULT;
+      break;
+    }
+
+    spin_lock(&port->rx_spinlock);
+    synccom_flist_remove_frame(&port->queued_iframes);
+    spin_unlock(&port->rx_spinlock);
+
     out_length += current_frame_length;
     if(!port->append_status) {
-        synccom_frame_remove_data(port->istream, NULL, 2);
+        synccom_ring_remove_data(&port->istream, NULL, 2);
     }
-    spin_unlock_irqrestore(&port->istream_spinlock, queued_flags);
 
     if (port->append_timestamp) {
-      memcpy(buf + out_length, &frame->timestamp, sizeof(frame->timestamp));
+      copy_to_iter(&frame->timestamp, sizeof(frame->timestamp), to);
       current_frame_length += sizeof(frame->timestamp);
       out_length += sizeof(frame->timestamp);
     }
@@ -291,51 +659,120 @@ ssize_t synccom_port_frame_read(struct synccom_port *port, char *buf,
   } while (port->rx_multiple);
 
   if (out_length == 0)
-    return -ENOBUFS;
+    return error_code;
 
   return out_length;
 }
 
-ssize_t synccom_port_read(struct synccom_port *port, char *buf, size_t count) {
+/*
+  Reads the next frame into info->buffer, without the status bytes, and fills
+  in the rest of info from the frame. The frame is left queued if it doesn't
+  fit, with its length filled in, or if it can't be copied to info->buffer.
+*/
+int synccom_port_read_frame(struct synccom_port *port,
+                            struct synccom_frame_info *info) {
+  struct synccom_frame *frame = 0;
+  unsigned char status[2];
+  unsigned frame_size = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+
+  if (synccom_port_is_streaming(port))
+    return -EINVAL;
+
+  /* The frames belong to the mmap()ed ring. */
+  if (synccom_rx_mmap_is_mapped(port))
+    return -EBUSY;
+
+  spin_lock(&port->rx_spinlock);
+  frame = synccom_flist_peek_front(&port->queued_iframes);
+  if (!frame ||
+      synccom_frame_get_frame_size(frame) >
+          synccom_ring_get_length(&port->istream)) {
+    spin_unlock(&port->rx_spinlock);
+    return -EAGAIN;
+  }
+
+  frame_size = synccom_frame_get_frame_size(frame);
+  info->length = (frame_size > 2) ? frame_size - 2 : 0;
+  if (info->length > info->buffer_size) {
+    spin_unlock(&port->rx_spinlock);
+    return -ENOBUFS;
+  }
+
+  spin_unlock(&port->rx_spinlock);
+
+  /* Only the reader takes frames off the queue, so the frame stays put until
+     its data has been copied out. A failed copy leaves both where they
+     were. */
+  if (!synccom_ring_remove_data(&port->istream,
+                                (char *)(unsigned long)info->buffer,
+                                info->length))
+    return -EFAULT;
+
+  memset(status, 0, sizeof(status));
+  synccom_ring_peek_data(&port->istream, 0, status,
+                         frame_size - info->length);
+  info->status = status[0] | (status[1] << 8);
+  info->sequence = frame->number;
+  info->timestamp_sec = frame->timestamp.tv_sec;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 0, 0)
+  info->timestamp_nsec = frame->timestamp.tv_nsec;
+#else
+  info->timestamp_nsec = frame->timestamp.tv_usec * 1000;
+#endif
+
+  synccom_ring_remove_data(&port->istream, NULL, frame_size - info->length);
+
+  spin_lock(&port->rx_spinlock);
+  synccom_flist_remove_frame(&port->queued_iframes);
+  spin_unlock(&port->rx_spinlock);
+
+  synccom_frame_delete(frame);
+
+  return 0;
+}
+
+ssize_t synccom_port_read(struct synccom_port *port, struct iov_iter *to) {
   return_val_if_untrue(port, 0);
 
+  if (synccom_rx_mmap_is_mapped(port))
+    return -EBUSY;
+
   if (synccom_port_is_streaming(port))
-    return synccom_port_stream_read(port, buf, count);
+    return synccom_port_stream_read(port, to);
   else
-    return synccom_port_frame_read(port, buf, count);
+    return synccom_port_frame_read(port, to);
 }
 
 unsigned synccom_port_has_incoming_data(struct synccom_port *port) {
   unsigned status = 0;
-  unsigned long irq_flags = 0, irq_flags2 = 0;
 
   return_val_if_untrue(port, 0);
 
   if (synccom_port_is_streaming(port)) {
-    spin_lock_irqsave(&port->istream_spinlock, irq_flags);
-    status = (synccom_frame_is_empty(port->istream)) ? 0 : 1;
-    spin_unlock_irqrestore(&port->istream_spinlock, irq_flags);
+    status = (synccom_ring_is_empty(&port->istream)) ? 0 : 1;
   } else {
     struct synccom_frame *frame = 0;
-    spin_lock_irqsave(&port->istream_spinlock, irq_flags);
-    spin_lock_irqsave(&port->queued_iframes_spinlock, irq_flags2);
+    spin_lock(&port->rx_spinlock);
     frame = synccom_flist_peek_front(&port->queued_iframes);
-    if (!frame || (frame->frame_size > synccom_frame_get_length(port->istream)))
+    if (!frame || (frame->frame_size > synccom_ring_get_length(&port->istream)))
         status = 0;
     else
         status = 1;
-    spin_unlock_irqrestore(&port->queued_iframes_spinlock, irq_flags2);
-    spin_unlock_irqrestore(&port->istream_spinlock, irq_flags);
+    spin_unlock(&port->rx_spinlock);
   }
 
   return status;
 }
 
+/* A frame handed over with the URB is ours to free. */
 static void write_data_callback(struct urb *urb) {
   struct synccom_port *port;
   int transfer_size = 0;
 
   port = urb->context;
+
   if (urb->status) {
     if (!(urb->status == -ENOENT || urb->status == -ECONNRESET ||
           urb->status == -ESHUTDOWN))
@@ -346,12 +783,16 @@ static void write_data_callback(struct urb *urb) {
     spin_lock(&port->err_lock);
     port->errors = urb->status;
     spin_unlock(&port->err_lock);
-    return;
+  } else {
+    transfer_size = urb->actual_length;
+    dev_dbg(port->device, "Actually wrote %d bytes.", transfer_size);
   }
-  transfer_size = urb->actual_length;
-  dev_dbg(port->device, "Actually wrote %d bytes.", transfer_size);
-  kfree(urb->transfer_buffer);
-  usb_free_urb(urb);
+
+  synccom_port_put_tx_urb(port, urb);
+
+  /* There's room for another frame now, both in the pool and in memory. */
+  synccom_port_kick_oframe_worker(port);
+  wake_up_interruptible(&port->output_queue);
 }
 
 /*
@@ -381,17 +822,23 @@ static void read_data_callback(struct urb *urb) {
   struct synccom_port *port;
   int transfer_size = 0;
   unsigned payload = 0;
-  int i = 0;
-  unsigned char temp = 0;
+  unsigned offset = 0;
+  unsigned record_size = 0;
+  unsigned received = 0;
+  unsigned dropped = 0;
   unsigned char *data_buffer = 0;
-  unsigned long istream_flags = 0;
+  unsigned char *record = 0;
   static unsigned char errorcheck1=0, errorcheck2=0;
 
   port = urb->context;
   data_buffer = urb->transfer_buffer;
 
   if (urb->status) {
-    // killed, unlinked, config changed or bad, someone else should resubmit
+    // killed by synccom_port_stop_rx(), whoever stopped us will resubmit
+    if (urb->status == -ENOENT)
+      return;
+
+    // unlinked, config changed or bad, someone else should resubmit
     if (!(urb->status == -ENOENT || urb->status == -ECONNRESET ||
           urb->status == -ESHUTDOWN))
       dev_err(&port->interface->dev,
@@ -414,121 +861,155 @@ static void read_data_callback(struct urb *urb) {
     usb_submit_urb(urb, GFP_ATOMIC);
     return;
   }
-  payload = data_buffer[0] << 8;
-  payload |= data_buffer[1];
-  if(errorcheck1 == data_buffer[0]
-    && errorcheck2 == data_buffer[1]
-    && errorcheck1 == errorcheck2) {
-      // There's a bug where for some reason sometimes the first
-      // two bytes of the buffer are a repeat of the last two of a previous
-      // read, instead of the payload size.
-      // For now, we're saving the last two bytes of every chunk of received
-      // data, and comparing it to the first two bytes. It's not perfect.
-      // This needs to be resolved in the firmware.
-      dev_info(port->device,
-        "Payload wrong, using buffer_size! Payload: %d, Size: %d, first two bytes 0x%2.2x 0x%2.2x",
-        payload, transfer_size, data_buffer[0], data_buffer[1]);
-      payload = transfer_size - 2;
-  }
-
-  errorcheck1 = data_buffer[transfer_size-1];
-  errorcheck2 = data_buffer[transfer_size-2];
-
-  if (synccom_port_get_input_memory_usage(port) + payload >
-      synccom_port_get_input_memory_cap(port)) {
-    dev_warn(port->device, "Input memory overflow - discarding data. Cap: %d, Size: %d", synccom_port_get_input_memory_cap(port), synccom_port_get_input_memory_usage(port) + payload);
-    usb_submit_urb(urb, GFP_ATOMIC);
-    return;
+
+  /* Each packet of the transfer is its own record, starting with a 2 byte
+     payload length. */
+  for (offset = 0; offset + 2 <= transfer_size; offset += port->rx_packet_size) {
+    record = data_buffer + offset;
+    record_size = min((unsigned)transfer_size - offset, port->rx_packet_size);
+
+    payload = record[0] << 8;
+    payload |= record[1];
+    if(errorcheck1 == record[0]
+      && errorcheck2 == record[1]
+      && errorcheck1 == errorcheck2) {
+        // There's a bug where for some reason sometimes the first
+        // two bytes of the buffer are a repeat of the last two of a previous
+        // read, instead of the payload size.
+        // For now, we're saving the last two bytes of every chunk of received
+        // data, and comparing it to the first two bytes. It's not perfect.
+        // This needs to be resolved in the firmware.
+        dev_info(port->device,
+          "Payload wrong, using buffer_size! Payload: %d, Size: %d, first two bytes 0x%2.2x 0x%2.2x",
+          payload, record_size, record[0], record[1]);
+        payload = record_size - 2;
+    }
+
+    errorcheck1 = record[record_size-1];
+    errorcheck2 = record[record_size-2];
+
+    if (payload > record_size - 2) {
+      dev_warn(port->device, "Payload larger than packet! Payload: %d, Size: %d",
+               payload, record_size);
+      payload = record_size - 2;
+    }
+
+    if (payload == 0)
+      continue;
+
+    if (synccom_port_get_input_memory_usage(port) + payload >
+        synccom_port_get_input_memory_cap(port)) {
+      dev_warn(port->device, "Input memory overflow - discarding data. Cap: %d, Size: %d", synccom_port_get_input_memory_cap(port), synccom_port_get_input_memory_usage(port) + payload);
+      dropped += payload;
+      continue;
+    }
+
+    /* The device sends byte swapped 16 bit words, which are put back in
+       order while being copied into the ring. */
+    if (!synccom_ring_add_data_swab16(&port->istream, record + 2, payload)) {
+      dev_warn(port->device, "Input ring full - discarding data. Size: %d", payload);
+      dropped += payload;
+      continue;
+    }
+
+    received += payload;
   }
 
-  for (i = 0; i < (payload + 2); i += 2) {
-    temp = data_buffer[i];
-    data_buffer[i] = data_buffer[i + 1];
-    data_buffer[i + 1] = temp;
+  if (received) {
+    if (synccom_port_is_streaming(port))
+      synccom_port_kick_stream_readers(port);
+    else
+      synccom_port_kick_bclist_worker(port, received);
   }
-  spin_lock_irqsave(&port->istream_spinlock, istream_flags);
-  synccom_frame_add_data(port->istream, data_buffer + 2, payload);
-  spin_unlock_irqrestore(&port->istream_spinlock, istream_flags);
 
-  if (synccom_port_is_streaming(port))
-    wake_up_interruptible(&port->input_queue);
-  else
-    schedule_work(&port->bclist_worker);
+  /* The application can hand descriptors back without making a system call,
+     and only the worker reclaims their space, so don't wait for it. */
+  if (dropped && synccom_rx_mmap_is_mapped(port))
+    synccom_port_run_bclist_worker(port);
 
   usb_submit_urb(urb, GFP_ATOMIC);
 }
 
-__u32 synccom_port_get_register(struct synccom_port *port, unsigned bar,
-                                unsigned register_offset, int need_lock) {
-  unsigned offset;
-  __u32 *value = NULL;
-  __u32 fvalue = 0;
-  int command = 0x6b;
-  int count;
-  char *msg = NULL;
-
-  struct synccom_port *dev;
-  dev = port;
-
-  return_val_if_untrue(port, 0);
-  return_val_if_untrue(bar <= 2, 0);
-
-  offset = port_offset(port, bar, register_offset);
+/*
+  Returns a negative value if the register has to be read from the card.
+  Called with register_access_mutex held, like everything that updates the
+  cache.
+*/
+static synccom_register synccom_port_get_cached_register(struct synccom_port *port,
+                                                         unsigned bar,
+                                                         unsigned register_offset) {
+  if (!is_cacheable_register(bar, register_offset) ||
+      port->stale_registers & (1 << (register_offset / 4)))
+    return -1;
 
-  msg = kmalloc(3, GFP_KERNEL);
-  value = kmalloc(sizeof(__u32) * 1, GFP_KERNEL);
+  return ((synccom_register *)&port->register_storage)[register_offset / 4];
+}
 
-  msg[0] = command;
-  msg[1] = (offset >> 8) & 0xFF;
-  msg[2] = offset & 0xFF;
+static void synccom_port_cache_register(struct synccom_port *port,
+                                        unsigned bar, unsigned register_offset,
+                                        __u32 value) {
+  if (!is_cacheable_register(bar, register_offset))
+    return;
 
-  if (need_lock) {
-    mutex_lock(&port->register_access_mutex);
-  }
-  usb_bulk_msg(port->udev, usb_sndbulkpipe(port->udev, 1), msg, sizeof(msg), &count, HZ * 10);
-  usb_bulk_msg(port->udev, usb_rcvbulkpipe(port->udev, 1), value, sizeof(value), &count, HZ * 10);
-  if (need_lock) {
-    mutex_unlock(&port->register_access_mutex);
-  }
-  fvalue = ((*value>>24)&0xff) | ((*value<<8)&0xff0000) | ((*value>>8)&0xff00) | ((*value<<24)&0xff000000);
+  ((synccom_register *)&port->register_storage)[register_offset / 4] = value;
+  port->stale_registers &= ~(1 << (register_offset / 4));
+}
 
-  kfree(msg);
-  kfree(value);
+/* The write may or may not have reached the card. */
+static void synccom_port_invalidate_register(struct synccom_port *port,
+                                             unsigned bar,
+                                             unsigned register_offset) {
+  if (!is_cacheable_register(bar, register_offset))
+    return;
 
-  return fvalue;
+  port->stale_registers |= 1 << (register_offset / 4);
 }
 
-int synccom_port_set_register(struct synccom_port *port, unsigned bar,
-                              unsigned register_offset, __u32 value,
-                              int need_lock) {
-  unsigned offset = 0;
-  int command = 0x6a;
-  char *msg;
-  int count;
+__u32 synccom_port_get_register(struct synccom_port *port, unsigned bar,
+                                unsigned register_offset, int need_lock) {
+  struct synccom_transaction *transaction = 0;
+  synccom_register cached_value = 0;
+  __u32 value = 0;
+  int index = 0;
 
   return_val_if_untrue(port, 0);
   return_val_if_untrue(bar <= 2, 0);
 
-  offset = port_offset(port, bar, register_offset);
-
-  msg = kmalloc(7, GFP_KERNEL);
-  msg[0] = command;
-  msg[1] = (offset >> 8) & 0xFF;
-  msg[2] = offset & 0xFF;
-  msg[3] = (value >> 24) & 0xFF;
-  msg[4] = (value >> 16) & 0xFF;
-  msg[5] = (value >> 8) & 0xFF;
-  msg[6] = value & 0xFF;
   if (need_lock) {
     mutex_lock(&port->register_access_mutex);
   }
-  usb_bulk_msg(port->udev, usb_sndbulkpipe(port->udev, 1), msg, sizeof(msg), &count, HZ*10);
+
+  cached_value = synccom_port_get_cached_register(port, bar, register_offset);
+  if (cached_value >= 0) {
+    value = (__u32)cached_value;
+    goto done;
+  }
+
+  transaction = synccom_transaction_get(port);
+  if (transaction) {
+    index = synccom_transaction_add_read(transaction, bar, register_offset);
+
+    if (index >= 0 && synccom_transaction_execute(transaction) == 0) {
+      value = synccom_transaction_get_value(transaction, index);
+      synccom_port_cache_register(port, bar, register_offset, value);
+    }
+
+    synccom_transaction_put(transaction);
+  }
+
+done:
   if (need_lock) {
     mutex_unlock(&port->register_access_mutex);
   }
-  kfree(msg);
 
-  if (bar == 0) {
+  return value;
+}
+
+/* Mirrors a register write into register_storage. */
+static void synccom_port_store_register(struct synccom_port *port,
+                                        unsigned bar, unsigned register_offset,
+                                        __u32 value) {
+  if (bar == 0 && register_offset <= MAX_OFFSET) {
     synccom_register old_value = ((synccom_register *)&port->register_storage)[register_offset / 4];
     ((synccom_register *)&port->register_storage)[register_offset / 4] = value;
 
@@ -550,6 +1031,48 @@ int synccom_port_set_register(struct synccom_port *port, unsigned bar,
       dev_dbg(port->device, "2:00 0x%08x\n", value);
     }
   }
+}
+
+int synccom_port_set_register(struct synccom_port *port, unsigned bar,
+                              unsigned register_offset, __u32 value,
+                              int need_lock) {
+  struct synccom_transaction *transaction = 0;
+  int status = 0;
+
+  return_val_if_untrue(port, 0);
+  return_val_if_untrue(bar <= 2, 0);
+
+  if (need_lock) {
+    mutex_lock(&port->register_access_mutex);
+  }
+
+  transaction = synccom_transaction_get(port);
+  if (!transaction) {
+    if (need_lock) {
+      mutex_unlock(&port->register_access_mutex);
+    }
+    return 0;
+  }
+
+  status = synccom_transaction_add_write(transaction, bar, register_offset,
+                                         value);
+
+  if (status >= 0)
+    status = synccom_transaction_execute(transaction);
+
+  synccom_transaction_put(transaction);
+
+  synccom_port_store_register(port, bar, register_offset, value);
+
+  if (need_lock) {
+    mutex_unlock(&port->register_access_mutex);
+  }
+
+  if (status < 0)
+    synccom_port_invalidate_register(port, bar, register_offset);
+
+  if (status == -ETIMEDOUT)
+    return status;
 
   return 1;
 }
@@ -559,59 +1082,75 @@ unsigned synccom_port_can_support_nonvolatile(struct synccom_port *port) {
   return 0;
 }
 
-__u32 synccom_port_get_nonvolatile(struct synccom_port *port, int need_lock) {
-  __u32 *value = NULL;
-  char *msg = NULL;
-  __u32 fvalue = 0;
-  int count;
-  int retval;
-
-  return_val_if_untrue(port, 0);
-
-  msg = kmalloc(1, GFP_KERNEL);
-  value = kmalloc(sizeof(__u32) * 1, GFP_KERNEL);
-
-  msg[0] = SYNCCOM_READ_NONVOLATILE;
+/* Sends a single firmware command and copies back its response. */
+static int synccom_port_command(struct synccom_port *port,
+                                const unsigned char *command, unsigned length,
+                                unsigned char *response,
+                                unsigned response_length, int need_lock) {
+  struct synccom_transaction *transaction = 0;
+  int index = 0;
+  int status = 0;
 
   if (need_lock) {
     mutex_lock(&port->register_access_mutex);
   }
-  retval = usb_bulk_msg(port->udev, usb_sndbulkpipe(port->udev, 1), msg, sizeof(msg), &count, HZ * 10);
-  retval = usb_bulk_msg(port->udev, usb_rcvbulkpipe(port->udev, 1), value, sizeof(value), &count, HZ * 10);
+
+  transaction = synccom_transaction_get(port);
+  if (!transaction) {
+    if (need_lock) {
+      mutex_unlock(&port->register_access_mutex);
+    }
+    return -EINTR;
+  }
+
+  index = synccom_transaction_add_command(transaction, command, length,
+                                          response_length);
+
+  status = (index >= 0) ? synccom_transaction_execute(transaction) : index;
+
+  if (status == 0 && response_length)
+    memcpy(response, synccom_transaction_get_response(transaction, index),
+           response_length);
+
+  synccom_transaction_put(transaction);
+
   if (need_lock) {
     mutex_unlock(&port->register_access_mutex);
   }
-  fvalue = ((*value >> 24) & 0xff) | ((*value << 8) & 0xff0000) |
-           ((*value >> 8) & 0xff00) | ((*value << 24) & 0xff000000);
+
+  return status;
+}
+
+__u32 synccom_port_get_nonvolatile(struct synccom_port *port, int need_lock) {
+  unsigned char msg[1];
+  unsigned char value[4] = {0};
+  __u32 fvalue = 0;
+
+  return_val_if_untrue(port, 0);
+
+  msg[0] = SYNCCOM_READ_NONVOLATILE;
+
+  synccom_port_command(port, msg, sizeof(msg), value, sizeof(value), need_lock);
+
+  fvalue = ((__u32)value[0] << 24) | ((__u32)value[1] << 16) |
+           ((__u32)value[2] << 8) | value[3];
 
   dev_dbg(port->device, "GET nonvolatile: %08x\n", fvalue);
-  kfree(msg);
-  kfree(value);
   return fvalue;
 }
 
 int synccom_port_set_nonvolatile(struct synccom_port *port, __u32 value, int need_lock) {
-  char *msg = NULL;
-  int retval = 0;
-  int count;
+  unsigned char msg[5];
 
   return_val_if_untrue(port, 0);
 
-  msg = kmalloc(5, GFP_KERNEL);
   msg[0] = SYNCCOM_WRITE_NONVOLATILE;
   msg[1] = (value >> 24) & 0xFF;
   msg[2] = (value >> 16) & 0xFF;
   msg[3] = (value >> 8) & 0xFF;
   msg[4] = value & 0xFF;
 
-  if (need_lock) {
-    mutex_lock(&port->register_access_mutex);
-  }
-  retval = usb_bulk_msg(port->udev, usb_sndbulkpipe(port->udev, 1), msg, sizeof(msg), &count, HZ*10);
-  if (need_lock) {
-    mutex_unlock(&port->register_access_mutex);
-  }
-  kfree(msg);
+  synccom_port_command(port, msg, sizeof(msg), 0, 0, need_lock);
   dev_dbg(port->device, "SET nonvolatile: %08x\n", value);
 
   return 1;
@@ -619,127 +1158,198 @@ int synccom_port_set_nonvolatile(struct synccom_port *port, __u32 value, int nee
 
 
 __u32 synccom_port_get_fx2(struct synccom_port *port, int need_lock) {
-  char *value = NULL;
-  char *msg = NULL;
+  unsigned char msg[1];
+  unsigned char value[2] = {0};
   __u32 fvalue = 0;
-  int count;
 
   return_val_if_untrue(port, 0);
 
-  msg = kzalloc(1, GFP_KERNEL);
-  value = kzalloc(2, GFP_KERNEL);
-
   msg[0] = SYNCCOM_READ_FX2_FIRMWARE;
 
-  if (need_lock) {
-    mutex_lock(&port->register_access_mutex);
-  }
-  usb_bulk_msg(port->udev, usb_sndbulkpipe(port->udev, 1), msg, 1, &count, HZ * 10);
-  usb_bulk_msg(port->udev, usb_rcvbulkpipe(port->udev, 1), value, 2, &count, HZ * 10);
-  if (need_lock) {
-    mutex_unlock(&port->register_access_mutex);
-  }
+  synccom_port_command(port, msg, sizeof(msg), value, sizeof(value), need_lock);
 
   fvalue = value[0];
   fvalue = (fvalue << 8) | value[1];
 
-  kfree(msg);
-  kfree(value);
-
   dev_dbg(port->device, "FX2: 0x%08x\n", fvalue);
   return fvalue;
 }
 
 
-int synccom_port_write_data(struct synccom_port *port, char *data,
-                            unsigned byte_count) {
-  struct urb *write_urb;
-  unsigned char *urb_buffer;
+/*
+  Submits the frame's buffer directly to the data endpoint, padded out to a
+  multiple of four bytes. On success the frame belongs to the URB and is freed
+  by write_data_callback(). Returns -EBUSY if WRITES_IN_FLIGHT transfers are
+  already outstanding, write_data_callback() will schedule another attempt.
+*/
+int synccom_port_write_frame(struct synccom_port *port,
+                             struct synccom_frame *frame) {
+  unsigned byte_count = 0;
+  unsigned length = 0;
+  int i = 0;
 
   return_val_if_untrue(port, -1);
-  return_val_if_untrue(data, -1);
-  return_val_if_untrue(byte_count > 0, -1);
+  return_val_if_untrue(frame, -1);
 
-  write_urb = usb_alloc_urb(0, GFP_ATOMIC);
-  if (!write_urb) {
-    dev_dbg(port->device, "%s: Couldn't alloc urb!", __func__);
-    return -1;
-  }
-  urb_buffer = kmalloc(byte_count, GFP_ATOMIC);
-  if (!urb_buffer) {
-    dev_dbg(port->device, "%s: Couldn't alloc buffer!", __func__);
-    usb_free_urb(write_urb);
-    return -1;
-  }
+  length = synccom_frame_get_length(frame);
+  byte_count = length + (4 - length % 4) % 4;
 
-  memcpy(urb_buffer, data, byte_count);
-  dev_dbg(port->device, "Attempting to write %d bytes.", byte_count);
-  usb_fill_bulk_urb(write_urb, port->udev, usb_sndbulkpipe(port->udev, 6),
-                    urb_buffer, byte_count, write_data_callback, port);
-  return usb_submit_urb(write_urb, GFP_ATOMIC);
-}
-
-void synccom_port_set_clock(struct synccom_port *port, unsigned bar,
-                            unsigned register_offset, char *data,
-                            unsigned byte_count) {
-
-  unsigned offset = 0;
-  int count;
-  char *msg = NULL;
-
-  return_if_untrue(port);
-  return_if_untrue(bar <= 2);
-  return_if_untrue(data);
-  return_if_untrue(byte_count > 0);
-
-  msg = kmalloc(7, GFP_KERNEL);
+  return_val_if_untrue(byte_count > 0, -1);
+  return_val_if_untrue(byte_count <= synccom_frame_get_buffer_size(frame), -1);
 
-  offset = port_offset(port, bar, register_offset);
+  /* Recycled buffers may hold anything past the data. */
+  memset(frame->buffer + length, 0, byte_count - length);
 
-  msg[0] = 0x6a;
-  msg[1] = 0x00;
-  msg[2] = 0x40;
-  msg[3] = data[0];
-  msg[4] = data[1];
-  msg[5] = data[2];
-  msg[6] = data[3];
+  i = synccom_port_get_tx_urb(port);
+  if (i < 0)
+    return i;
 
-  usb_bulk_msg(port->udev, usb_sndbulkpipe(port->udev, 1), msg, 7, &count,
-               HZ * 10);
+  port->tx_frames[i] = frame;
 
-  kfree(msg);
+  return synccom_port_submit_tx_urb(port, i, frame->buffer, byte_count);
 }
 
+/* Every writable register goes out in as few transactions as possible. */
 int synccom_port_set_registers(struct synccom_port *port,
                                const struct synccom_registers *regs) {
+  struct synccom_transaction *transaction = 0;
   unsigned stalled = 0;
+  unsigned failed = 0;
   unsigned i = 0;
+  int status = 0;
 
   return_val_if_untrue(port, 0);
   return_val_if_untrue(regs, 0);
 
+  mutex_lock(&port->register_access_mutex);
+
+  transaction = synccom_transaction_get(port);
+  if (!transaction) {
+    mutex_unlock(&port->register_access_mutex);
+    return 0;
+  }
+
   for (i = 0; i < sizeof(*regs) / sizeof(synccom_register); i++) {
     unsigned register_offset = i * 4;
+    unsigned bar = 0;
 
     if (is_read_only_register(register_offset) ||
         ((synccom_register *)regs)[i] < 0) {
       continue;
     }
 
-    if (register_offset <= MAX_OFFSET) {
-      if (synccom_port_set_register(port, 0, register_offset,
-                                    ((synccom_register *)regs)[i],
-                                    1) == -ETIMEDOUT)
-        stalled = 1;
-    } else {
-      synccom_port_set_register(port, 2, FCR_OFFSET,
-                                ((synccom_register *)regs)[i], 1);
+    if (register_offset > MAX_OFFSET) {
+      bar = 2;
+      register_offset = FCR_OFFSET;
+    }
+
+    if (synccom_transaction_is_full(transaction)) {
+      status = synccom_transaction_execute(transaction);
+      failed |= (status < 0);
+      stalled |= (status == -ETIMEDOUT);
+
+      synccom_transaction_put(transaction);
+      transaction = synccom_transaction_get(port);
+      if (!transaction) {
+        failed = 1;
+        break;
+      }
     }
+
+    synccom_transaction_add_write(transaction, bar, register_offset,
+                                  ((synccom_register *)regs)[i]);
+    synccom_port_store_register(port, bar, register_offset,
+                                ((synccom_register *)regs)[i]);
+  }
+
+  if (transaction && transaction->num_commands) {
+    status = synccom_transaction_execute(transaction);
+    failed |= (status < 0);
+    stalled |= (status == -ETIMEDOUT);
   }
 
+  for (i = 0; failed && i < sizeof(*regs) / sizeof(synccom_register); i++) {
+    if (((synccom_register *)regs)[i] >= 0)
+      synccom_port_invalidate_register(port, 0, i * 4);
+  }
+
+  if (transaction)
+    synccom_transaction_put(transaction);
+
+  mutex_unlock(&port->register_access_mutex);
+
   return (stalled) ? -ETIMEDOUT : 1;
 }
 
+/* Reads every requested register from the card in as few transactions as
+   possible. */
+static int synccom_port_read_registers(struct synccom_port *port,
+                                       struct synccom_registers *regs) {
+  struct synccom_transaction *transaction = 0;
+  int indexes[sizeof(*regs) / sizeof(synccom_register)];
+  unsigned first = 0;
+  unsigned i = 0;
+  unsigned j = 0;
+  int status = 0;
+
+  mutex_lock(&port->register_access_mutex);
+
+  transaction = synccom_transaction_get(port);
+  if (!transaction) {
+    mutex_unlock(&port->register_access_mutex);
+    return -EINTR;
+  }
+
+  for (i = 0; i <= sizeof(*regs) / sizeof(synccom_register); i++) {
+    unsigned last = (i == sizeof(*regs) / sizeof(synccom_register));
+
+    if (last || synccom_transaction_is_full(transaction)) {
+      if (transaction->num_commands)
+        status = synccom_transaction_execute(transaction);
+
+      for (j = first; j < i; j++) {
+        __u32 value = 0;
+
+        if (indexes[j] < 0)
+          continue;
+
+        if (status == 0) {
+          value = synccom_transaction_get_value(transaction, indexes[j]);
+          synccom_port_cache_register(port, 0, j * 4, value);
+        }
+
+        ((synccom_register *)regs)[j] = value;
+      }
+
+      synccom_transaction_put(transaction);
+
+      if (last || status)
+        break;
+
+      transaction = synccom_transaction_get(port);
+      if (!transaction) {
+        status = -EINTR;
+        break;
+      }
+      first = i;
+    }
+
+    indexes[i] = -1;
+
+    if (((synccom_register *)regs)[i] != SYNCCOM_UPDATE_VALUE)
+      continue;
+
+    if (i * 4 <= MAX_OFFSET)
+      indexes[i] = synccom_transaction_add_read(transaction, 0, i * 4);
+    else
+      indexes[i] = synccom_transaction_add_read(transaction, 2, FCR_OFFSET);
+  }
+
+  mutex_unlock(&port->register_access_mutex);
+
+  return status;
+}
+
 void synccom_port_get_registers(struct synccom_port *port,
                                 struct synccom_registers *regs) {
   unsigned i = 0;
@@ -747,18 +1357,134 @@ void synccom_port_get_registers(struct synccom_port *port,
   return_if_untrue(port);
   return_if_untrue(regs);
 
+  /* Configuration registers come from the cache, only the rest hit the
+     wire. */
+  mutex_lock(&port->register_access_mutex);
   for (i = 0; i < sizeof(*regs) / sizeof(synccom_register); i++) {
+    synccom_register cached_value = 0;
+
     if (((synccom_register *)regs)[i] != SYNCCOM_UPDATE_VALUE)
       continue;
 
-    if (i * 4 <= MAX_OFFSET) {
-      ((synccom_register *)regs)[i] =
-          synccom_port_get_register(port, 0, i * 4, 1);
-    } else {
-      ((synccom_register *)regs)[i] =
-          synccom_port_get_register(port, 2, FCR_OFFSET, 1);
+    cached_value = synccom_port_get_cached_register(port, 0, i * 4);
+    if (cached_value >= 0)
+      ((synccom_register *)regs)[i] = cached_value;
+  }
+  mutex_unlock(&port->register_access_mutex);
+
+  synccom_port_read_registers(port, regs);
+}
+
+/* Re-reads every cached register from the card. */
+int synccom_port_refresh_registers(struct synccom_port *port) {
+  struct synccom_registers regs;
+  unsigned i = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+
+  SYNCCOM_REGISTERS_INIT(regs);
+
+  for (i = 0; i < sizeof(regs) / sizeof(synccom_register); i++) {
+    if (is_cacheable_register(0, i * 4))
+      ((synccom_register *)&regs)[i] = SYNCCOM_UPDATE_VALUE;
+  }
+
+  return synccom_port_read_registers(port, &regs);
+}
+
+static int synccom_port_add_register_op(struct synccom_transaction *transaction,
+                                       struct synccom_register_op *op) {
+  switch (op->op) {
+  case SYNCCOM_REGISTER_READ:
+    return synccom_transaction_add_read(transaction, op->bar, op->offset);
+
+  case SYNCCOM_REGISTER_WRITE:
+    return synccom_transaction_add_write(transaction, op->bar, op->offset,
+                                         op->value);
+  }
+
+  return -EINVAL;
+}
+
+/*
+  Runs a list of register operations back to back, packed into as few
+  transactions as possible. Read results are stored back into each
+  operation's value.
+*/
+int synccom_port_execute_register_ops(struct synccom_port *port,
+                                      struct synccom_register_op *ops,
+                                      unsigned count) {
+  struct synccom_transaction *transaction = 0;
+  int indexes[SYNCCOM_TRANSACTION_MAX_COMMANDS];
+  unsigned first = 0;
+  unsigned i = 0;
+  unsigned j = 0;
+  int status = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+  return_val_if_untrue(ops, -EINVAL);
+
+  for (i = 0; i < count; i++) {
+    if ((ops[i].bar != 0 && ops[i].bar != 2) || ops[i].offset % 4 ||
+        ops[i].offset > 0x7C || ops[i].op > SYNCCOM_REGISTER_WRITE ||
+        ops[i].reserved)
+      return -EINVAL;
+  }
+
+  mutex_lock(&port->register_access_mutex);
+
+  transaction = synccom_transaction_get(port);
+  if (!transaction) {
+    mutex_unlock(&port->register_access_mutex);
+    return -EINTR;
+  }
+
+  for (i = 0; i <= count; i++) {
+    if (i == count || synccom_transaction_is_full(transaction)) {
+      if (transaction->num_commands)
+        status = synccom_transaction_execute(transaction);
+
+      for (j = first; status != 0 && j < i; j++) {
+        if (ops[j].op == SYNCCOM_REGISTER_WRITE)
+          synccom_port_invalidate_register(port, ops[j].bar, ops[j].offset);
+      }
+
+      for (j = first; status == 0 && j < i; j++) {
+        if (ops[j].op == SYNCCOM_REGISTER_WRITE) {
+          if (ops[j].bar == 0 && ops[j].offset <= MAX_OFFSET)
+            synccom_port_store_register(port, 0, ops[j].offset, ops[j].value);
+          else if (ops[j].bar == 2 && ops[j].offset == FCR_OFFSET)
+            synccom_port_store_register(port, 2, FCR_OFFSET, ops[j].value);
+          continue;
+        }
+
+        ops[j].value =
+            synccom_transaction_get_value(transaction, indexes[j - first]);
+
+        if (ops[j].op == SYNCCOM_REGISTER_READ)
+          synccom_port_cache_register(port, ops[j].bar, ops[j].offset,
+                                      ops[j].value);
+      }
+
+      synccom_transaction_put(transaction);
+
+      if (i == count || status)
+        break;
+
+      transaction = synccom_transaction_get(port);
+      if (!transaction) {
+        status = -EINTR;
+        break;
+      }
+      first = i;
     }
+
+    indexes[i - first] = synccom_port_add_register_op(transaction, &ops[i]);
   }
+
+  mutex_unlock(&port->register_access_mutex);
+
+  return status;
 }
 
 __u32 synccom_port_get_TXCNT(struct synccom_port *port) {
@@ -827,37 +1553,31 @@ unsigned synccom_port_get_CE(struct synccom_port *port) {
 
 int synccom_port_purge_rx(struct synccom_port *port) {
   int error_code = 0;
-  unsigned long flags = 0;
   return_val_if_untrue(port, 0);
 
   dev_dbg(port->device, "purge_rx\n");
 
   mutex_lock(&port->running_bc_mutex);
 
+  /* The register access mutex is enough here, register access sleeps so it
+     can't be done under a spinlock. */
   mutex_lock(&port->register_access_mutex);
-  spin_lock_irqsave(&port->board_rx_spinlock, flags);
   error_code = synccom_port_execute_RRES(port, 0);
-  spin_unlock_irqrestore(&port->board_rx_spinlock, flags);
   mutex_unlock(&port->register_access_mutex);
 
-  spin_lock_irqsave(&port->queued_iframes_spinlock, flags);
-  synccom_flist_clear(&port->queued_iframes);
-  spin_unlock_irqrestore(&port->queued_iframes_spinlock, flags);
-
-  spin_lock_irqsave(&port->pending_iframes_spinlock, flags);
-  synccom_flist_clear(&port->pending_iframes);
-  spin_unlock_irqrestore(&port->pending_iframes_spinlock, flags);
-
-  spin_lock_irqsave(&port->istream_spinlock, flags);
-  synccom_frame_clear(port->istream);
-  spin_unlock_irqrestore(&port->istream_spinlock, flags);
-
-  spin_lock_irqsave(&port->pending_iframe_spinlock, flags);
-  if (port->pending_iframe) {
-    synccom_frame_delete(port->pending_iframe);
-    port->pending_iframe = 0;
+  if (error_code < 0) {
+    mutex_unlock(&port->running_bc_mutex);
+    return error_code;
   }
-  spin_unlock_irqrestore(&port->pending_iframe_spinlock, flags);
+
+  /* Clearing the ring is a consumer operation, so keep readers out. */
+  down(&port->read_semaphore);
+  spin_lock(&port->rx_spinlock);
+  synccom_flist_clear(&port->queued_iframes);
+  synccom_ring_clear(&port->istream);
+  synccom_rx_mmap_purge(port);
+  spin_unlock(&port->rx_spinlock);
+  up(&port->read_semaphore);
 
   mutex_unlock(&port->running_bc_mutex);
 
@@ -866,76 +1586,52 @@ int synccom_port_purge_rx(struct synccom_port *port) {
 
 int synccom_port_purge_tx(struct synccom_port *port) {
   int error_code = 0;
-  unsigned long flags = 0;
 
   return_val_if_untrue(port, 0);
 
   dev_dbg(port->device, "purge_tx\n");
 
   mutex_lock(&port->register_access_mutex);
-  spin_lock_irqsave(&port->board_tx_spinlock, flags);
   error_code = synccom_port_execute_TRES(port, 0);
-  spin_unlock_irqrestore(&port->board_tx_spinlock, flags);
   mutex_unlock(&port->register_access_mutex);
 
-  spin_lock_irqsave(&port->queued_oframes_spinlock, flags);
+  if (error_code < 0)
+    return error_code;
+
+  spin_lock(&port->tx_spinlock);
+  atomic_sub(synccom_flist_calculate_memory_usage(&port->queued_oframes),
+             &port->output_memory_usage);
   synccom_flist_clear(&port->queued_oframes);
-  spin_unlock_irqrestore(&port->queued_oframes_spinlock, flags);
 
-  spin_lock_irqsave(&port->pending_oframe_spinlock, flags);
   if (port->pending_oframe) {
+    atomic_sub(synccom_frame_get_length(port->pending_oframe),
+               &port->output_memory_usage);
     synccom_frame_delete(port->pending_oframe);
     port->pending_oframe = 0;
   }
-  spin_unlock_irqrestore(&port->pending_oframe_spinlock, flags);
+
+  synccom_tx_mmap_purge(port);
+  spin_unlock(&port->tx_spinlock);
 
   wake_up_interruptible(&port->output_queue);
 
   return 1;
 }
 
+/*
+  Received frames only carry their lengths, all of the data is in istream,
+  whose length can be read without any locks.
+*/
 unsigned synccom_port_get_input_memory_usage(struct synccom_port *port) {
-  unsigned value = 0;
-  unsigned long pending_flags;
-  unsigned long queued_flags;
-  unsigned long stream_flags;
-
   return_val_if_untrue(port, 0);
 
-  spin_lock_irqsave(&port->queued_iframes_spinlock, queued_flags);
-  value = port->queued_iframes.estimated_memory_usage;
-  spin_unlock_irqrestore(&port->queued_iframes_spinlock, queued_flags);
-
-  spin_lock_irqsave(&port->istream_spinlock, stream_flags);
-  value += synccom_frame_get_length(port->istream);
-  spin_unlock_irqrestore(&port->istream_spinlock, stream_flags);
-
-  spin_lock_irqsave(&port->pending_iframe_spinlock, pending_flags);
-  if (port->pending_iframe)
-    value += synccom_frame_get_length(port->pending_iframe);
-  spin_unlock_irqrestore(&port->pending_iframe_spinlock, pending_flags);
-
-  return value;
+  return synccom_ring_get_length(&port->istream);
 }
 
 unsigned synccom_port_get_output_memory_usage(struct synccom_port *port) {
-
-  unsigned value = 0;
-  unsigned long pending_flags;
-  unsigned long queued_flags;
-
   return_val_if_untrue(port, 0);
 
-  spin_lock_irqsave(&port->queued_oframes_spinlock, queued_flags);
-  value = port->queued_oframes.estimated_memory_usage;
-  spin_unlock_irqrestore(&port->queued_oframes_spinlock, queued_flags);
-
-  spin_lock_irqsave(&port->pending_oframe_spinlock, pending_flags);
-  if (port->pending_oframe)
-    value += synccom_frame_get_length(port->pending_oframe);
-  spin_unlock_irqrestore(&port->pending_oframe_spinlock, pending_flags);
-
-  return value;
+  return atomic_read(&port->output_memory_usage);
 }
 
 unsigned synccom_port_get_input_memory_cap(struct synccom_port *port) {
@@ -951,10 +1647,12 @@ unsigned synccom_port_get_output_memory_cap(struct synccom_port *port) {
   return port->memory_cap.output;
 }
 
-void synccom_port_set_memory_cap(struct synccom_port *port,
-                                 struct synccom_memory_cap *value) {
-  return_if_untrue(port);
-  return_if_untrue(value);
+int synccom_port_set_memory_cap(struct synccom_port *port,
+                                struct synccom_memory_cap *value) {
+  int error_code = 1;
+
+  return_val_if_untrue(port, 0);
+  return_val_if_untrue(value, 0);
 
   if (value->input >= 0) {
     if (port->memory_cap.input != value->input) {
@@ -964,7 +1662,32 @@ void synccom_port_set_memory_cap(struct synccom_port *port,
       dev_dbg(port->device, "memory cap (input) %i\n", value->input);
     }
 
-    port->memory_cap.input = value->input;
+    if (port->memory_cap.input != value->input) {
+      /* The receive ring is sized from the input cap, so stop both sides of
+         it while it is reallocated. */
+      synccom_rx_mmap_flush(port);
+      down(&port->read_semaphore);
+
+      /* The application has the ring's buffer mapped. The output cap is
+         still applied below. */
+      if (synccom_rx_mmap_is_mapped(port)) {
+        error_code = -EBUSY;
+      } else {
+        synccom_port_stop_rx(port);
+
+        /* Dropping data would leave queued_iframes out of step with it. */
+        if (synccom_ring_get_length(&port->istream) > (unsigned)value->input)
+          error_code = -EBUSY;
+        else if (synccom_ring_resize(&port->istream, value->input))
+          port->memory_cap.input = value->input;
+        else
+          error_code = -ENOMEM;
+
+        synccom_port_start_rx(port);
+      }
+
+      up(&port->read_semaphore);
+    }
   }
 
   if (value->output >= 0) {
@@ -977,6 +1700,75 @@ void synccom_port_set_memory_cap(struct synccom_port *port,
 
     port->memory_cap.output = value->output;
   }
+
+  return error_code;
+}
+
+int synccom_port_set_rx_urbs(struct synccom_port *port,
+                             struct synccom_rx_urbs *value) {
+  unsigned long flags = 0;
+  unsigned old_count = 0;
+  unsigned old_size = 0;
+  int error_code = 1;
+
+  return_val_if_untrue(port, 0);
+  return_val_if_untrue(value, 0);
+
+  /* -1, from SYNCCOM_RX_URBS_INIT, leaves the value as it is. */
+  if (value->count != -1 &&
+      (value->count <= 0 || value->count > MAX_RX_URB_COUNT))
+    return -EINVAL;
+
+  if (value->size != -1 &&
+      (value->size <= 0 || value->size > MAX_RX_URB_SIZE))
+    return -EINVAL;
+
+  /* Keep the readers out so nobody races set_memory_cap() stopping rx. */
+  down(&port->read_semaphore);
+  synccom_port_stop_rx(port);
+  synccom_port_destroy_urbs(port);
+
+  old_count = port->rx_urb_count;
+  old_size = port->rx_urb_size;
+
+  if (value->count != -1)
+    port->rx_urb_count = value->count;
+
+  if (value->size != -1)
+    port->rx_urb_size = value->size;
+
+  if (synccom_port_create_urbs(port) < 0) {
+    port->rx_urb_count = old_count;
+    port->rx_urb_size = old_size;
+    error_code = -ENOMEM;
+
+    /* Without the old urbs nothing more will be received, so flush()
+       reports it too. */
+    if (synccom_port_create_urbs(port) < 0) {
+      dev_err(port->device, "%s - receive stopped\n", __func__);
+
+      spin_lock_irqsave(&port->err_lock, flags);
+      port->errors = -EIO;
+      spin_unlock_irqrestore(&port->err_lock, flags);
+    }
+  }
+
+  dev_dbg(port->device, "receive urbs %u x %u => %u x %u\n", old_count,
+          old_size, port->rx_urb_count, port->rx_urb_size);
+
+  synccom_port_start_rx(port);
+  up(&port->read_semaphore);
+
+  return error_code;
+}
+
+void synccom_port_get_rx_urbs(struct synccom_port *port,
+                              struct synccom_rx_urbs *value) {
+  return_if_untrue(port);
+  return_if_untrue(value);
+
+  value->count = port->rx_urb_count;
+  value->size = port->rx_urb_size;
 }
 
 #define STRB_BASE 0x00000008
@@ -992,7 +1784,7 @@ void synccom_port_set_clock_bits(struct synccom_port *port,
   unsigned strb_value = STRB_BASE;
   unsigned dta_value = DTA_BASE;
   unsigned clk_value = CLK_BASE;
-  char buf_data[4];
+  struct synccom_transaction *transaction = 0;
   __u32 *data = 0;
   unsigned data_index = 0;
 
@@ -1013,7 +1805,7 @@ void synccom_port_set_clock_bits(struct synccom_port *port,
   }
 
   mutex_lock(&port->register_access_mutex);
-  // Don't spinlock here because usb_bulk_msg may sleep.
+  // Don't spinlock here because the transactions sleep.
   // spin_lock_irqsave(&port->board_settings_spinlock, flags);
   orig_fcr_value = synccom_port_get_register(port, 2, FCR_OFFSET, 0);
 
@@ -1043,13 +1835,24 @@ void synccom_port_set_clock_bits(struct synccom_port *port,
   data[data_index++] = new_fcr_value;
   data[data_index++] = orig_fcr_value;
 
-  for (i = 0; i < 323; i++) {
-    buf_data[0] = data[i] >> 24;
-    buf_data[1] = data[i] >> 16;
-    buf_data[2] = data[i] >> 8;
-    buf_data[3] = data[i] >> 0;
+  /* The bit-banged sequence only depends on write order, so it can be packed
+     into as few transactions as fit. */
+  transaction = synccom_transaction_get(port);
+  for (i = 0; transaction && i < data_index; i++) {
+    if (synccom_transaction_is_full(transaction)) {
+      synccom_transaction_execute(transaction);
+      synccom_transaction_put(transaction);
+      transaction = synccom_transaction_get(port);
+      if (!transaction)
+        break;
+    }
+
+    synccom_transaction_add_write(transaction, 2, FCR_OFFSET, data[i]);
+  }
 
-    synccom_port_set_clock(port, 0, FCR_OFFSET, &buf_data[0], data_index);
+  if (transaction) {
+    synccom_transaction_execute(transaction);
+    synccom_transaction_put(transaction);
   }
   // spin_unlock_irqrestore(&port->board_settings_spinlock, flags);
   mutex_unlock(&port->register_access_mutex);
@@ -1131,15 +1934,144 @@ unsigned synccom_port_get_rx_multiple(struct synccom_port *port) {
   return port->rx_multiple;
 }
 
+void synccom_port_set_rx_coalesce_bytes(struct synccom_port *port,
+                                        unsigned value) {
+  return_if_untrue(port);
+
+  if (port->rx_coalesce_bytes != value) {
+    dev_dbg(port->device, "receive coalesce bytes %i => %i",
+            port->rx_coalesce_bytes, value);
+  } else {
+    dev_dbg(port->device, "receive coalesce bytes = %i", value);
+  }
+
+  port->rx_coalesce_bytes = value;
+}
+
+unsigned synccom_port_get_rx_coalesce_bytes(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return port->rx_coalesce_bytes;
+}
+
+void synccom_port_set_rx_coalesce_usecs(struct synccom_port *port,
+                                        unsigned value) {
+  return_if_untrue(port);
+
+  if (port->rx_coalesce_usecs != value) {
+    dev_dbg(port->device, "receive coalesce usecs %i => %i",
+            port->rx_coalesce_usecs, value);
+  } else {
+    dev_dbg(port->device, "receive coalesce usecs = %i", value);
+  }
+
+  port->rx_coalesce_usecs = value;
+}
+
+unsigned synccom_port_get_rx_coalesce_usecs(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return port->rx_coalesce_usecs;
+}
+
+void synccom_port_set_rx_watermark_bytes(struct synccom_port *port,
+                                         unsigned value) {
+  return_if_untrue(port);
+
+  if (port->rx_watermark_bytes != value) {
+    dev_dbg(port->device, "receive watermark bytes %i => %i",
+            port->rx_watermark_bytes, value);
+  } else {
+    dev_dbg(port->device, "receive watermark bytes = %i", value);
+  }
+
+  port->rx_watermark_bytes = value;
+}
+
+unsigned synccom_port_get_rx_watermark_bytes(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return port->rx_watermark_bytes;
+}
+
+void synccom_port_set_rx_watermark_usecs(struct synccom_port *port,
+                                         unsigned value) {
+  return_if_untrue(port);
+
+  if (port->rx_watermark_usecs != value) {
+    dev_dbg(port->device, "receive watermark usecs %i => %i",
+            port->rx_watermark_usecs, value);
+  } else {
+    dev_dbg(port->device, "receive watermark usecs = %i", value);
+  }
+
+  port->rx_watermark_usecs = value;
+}
+
+unsigned synccom_port_get_rx_watermark_usecs(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return port->rx_watermark_usecs;
+}
+
+/* 0 turns aggregation off, anything past TX_AGGREGATE_SIZE is capped. */
+void synccom_port_set_tx_aggregate_bytes(struct synccom_port *port,
+                                         unsigned value) {
+  return_if_untrue(port);
+
+  value = min_t(unsigned, value, TX_AGGREGATE_SIZE);
+
+  if (port->tx_aggregate_bytes != value) {
+    dev_dbg(port->device, "transmit aggregate bytes %i => %i",
+            port->tx_aggregate_bytes, value);
+  } else {
+    dev_dbg(port->device, "transmit aggregate bytes = %i", value);
+  }
+
+  port->tx_aggregate_bytes = value;
+}
+
+unsigned synccom_port_get_tx_aggregate_bytes(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return port->tx_aggregate_bytes;
+}
+
+void synccom_port_set_tx_aggregate_usecs(struct synccom_port *port,
+                                         unsigned value) {
+  return_if_untrue(port);
+
+  if (port->tx_aggregate_usecs != value) {
+    dev_dbg(port->device, "transmit aggregate usecs %i => %i",
+            port->tx_aggregate_usecs, value);
+  } else {
+    dev_dbg(port->device, "transmit aggregate usecs = %i", value);
+  }
+
+  port->tx_aggregate_usecs = value;
+}
+
+unsigned synccom_port_get_tx_aggregate_usecs(struct synccom_port *port) {
+  return_val_if_untrue(port, 0);
+
+  return port->tx_aggregate_usecs;
+}
+
 int synccom_port_execute_TRES(struct synccom_port *port, int need_lock) {
   return_val_if_untrue(port, 0);
 
+  if (!port->ignore_timeout && synccom_port_timed_out(port, need_lock))
+    return -ETIMEDOUT;
+
   return synccom_port_set_register(port, 0, CMDR_OFFSET, 0x08000000, need_lock);
 }
 
 int synccom_port_execute_RRES(struct synccom_port *port, int need_lock) {
   return_val_if_untrue(port, 0);
 
+  if (!port->ignore_timeout && synccom_port_timed_out(port, need_lock))
+    return -ETIMEDOUT;
+
   return synccom_port_set_register(port, 0, CMDR_OFFSET, 0x00020000, need_lock);
 }
 
@@ -1163,32 +2095,38 @@ unsigned synccom_port_is_streaming(struct synccom_port *port) {
              : 0;
 }
 
-int synccom_port_set_tx_modifiers(struct synccom_port *port, int value) {
-  return_val_if_untrue(port, 0);
-
+unsigned synccom_port_is_valid_tx_modifiers(int value) {
   switch (value) {
   case XF:
   case XF | TXT:
   case XF | TXEXT:
   case XREP:
   case XREP | TXT:
-    if (port->tx_modifiers != value) {
-      dev_dbg(port->device, "transmit modifiers 0x%x => 0x%x\n",
-              port->tx_modifiers, value);
-    } else {
-      dev_dbg(port->device, "transmit modifiers 0x%x\n", value);
-    }
+    return 1;
 
-    port->tx_modifiers = value;
+  default:
+    return 0;
+  }
+}
 
-    break;
+int synccom_port_set_tx_modifiers(struct synccom_port *port, int value) {
+  return_val_if_untrue(port, 0);
 
-  default:
+  if (!synccom_port_is_valid_tx_modifiers(value)) {
     dev_warn(port->device, "tx modifiers (invalid value 0x%x)\n", value);
 
     return -EINVAL;
   }
 
+  if (port->tx_modifiers != value) {
+    dev_dbg(port->device, "transmit modifiers 0x%x => 0x%x\n",
+            port->tx_modifiers, value);
+  } else {
+    dev_dbg(port->device, "transmit modifiers 0x%x\n", value);
+  }
+
+  port->tx_modifiers = value;
+
   return 1;
 }
 
@@ -1198,154 +2136,357 @@ unsigned synccom_port_get_tx_modifiers(struct synccom_port *port) {
   return port->tx_modifiers;
 }
 
-void synccom_port_execute_transmit(struct synccom_port *port, unsigned dma) {
-
-  unsigned command_register = 0;
-  unsigned command_value = 0;
-  unsigned command_bar = 0;
-
-  return_if_untrue(port);
-
-  command_bar = 0;
-  command_register = CMDR_OFFSET;
-  command_value = 0x01000000;
+/* The CMDR value that starts a transmit with the given tx_modifiers. */
+static __u32 synccom_port_get_transmit_command(int tx_modifiers) {
+  __u32 command_value = 0x01000000;
 
-  if (port->tx_modifiers & XREP)
+  if (tx_modifiers & XREP)
     command_value |= 0x02000000;
 
-  if (port->tx_modifiers & TXT)
+  if (tx_modifiers & TXT)
     command_value |= 0x10000000;
 
-  if (port->tx_modifiers & TXEXT)
+  if (tx_modifiers & TXEXT)
     command_value |= 0x20000000;
 
-  synccom_port_set_register(port, command_bar, command_register, command_value,
+  return command_value;
+}
+
+void synccom_port_execute_transmit(struct synccom_port *port, unsigned dma) {
+  return_if_untrue(port);
+
+  synccom_port_set_register(port, 0, CMDR_OFFSET,
+                            synccom_port_get_transmit_command(port->tx_modifiers),
                             1);
 }
 
-#define TX_FIFO_SIZE 100000
+/*
+  Returns 2 once the whole frame has been handed to the data endpoint, after
+  which the caller no longer owns it, or 0 if it couldn't be sent.
+*/
 int prepare_frame_for_fifo(struct synccom_port *port,
                            struct synccom_frame *frame, unsigned *length) {
-  unsigned current_length = 0;
-  unsigned fifo_space = 0;
-  unsigned transmit_length = 0;
-  unsigned frame_size = 0;
-  unsigned size_in_fifo = 0;
-
-  current_length = synccom_frame_get_length(frame);
-  size_in_fifo = ((current_length % 4) == 0)
-                     ? current_length
-                     : current_length + (4 - current_length % 4);
-  frame_size = synccom_frame_get_frame_size(frame);
-  fifo_space = TX_FIFO_SIZE - 1;
-  fifo_space -= fifo_space % 4;
-  /* Determine the maximum amount of data we can send this time around. */
-  transmit_length = (size_in_fifo > fifo_space) ? fifo_space : size_in_fifo;
+  *length = synccom_frame_get_length(frame);
 
-  if (transmit_length < 1)
+  if (*length < 1)
     return 0;
 
-  if(synccom_port_write_data(port, frame->buffer, transmit_length)==0)
-    synccom_frame_remove_data(frame, NULL, transmit_length);
-
-  *length = transmit_length;
-
-  /* If this is the first time we add data to the FIFO for this frame we
-     tell the port how much data is in this frame. */
-  if (current_length == frame_size)
-    synccom_port_set_register(port, 0, BC_FIFO_L_OFFSET, frame_size, 1);
+  if (synccom_port_write_frame(port, frame) != 0) {
+    *length = 0;
+    return 0;
+  }
 
-  /* We still have more data to send. */
-  if (!synccom_frame_is_empty(frame))
-    return 1;
   return 2;
 }
 
+/*
+  Hands the frame to the data endpoint and adds the BC_FIFO_L and transmit
+  command writes that go with it to the transaction. The transaction needs
+  room for two more commands.
+*/
 unsigned synccom_port_transmit_frame(struct synccom_port *port,
-                                     struct synccom_frame *frame) {
+                                     struct synccom_frame *frame,
+                                     struct synccom_transaction *transaction) {
   unsigned transmit_length = 0;
+  unsigned frame_size = 0;
+  unsigned number = 0;
+  int tx_modifiers = 0;
   int result;
 
+  /* The frame may already be gone once it has been handed off. */
+  frame_size = synccom_frame_get_frame_size(frame);
+  number = frame->number;
+  tx_modifiers = frame->tx_modifiers;
   result = prepare_frame_for_fifo(port, frame, &transmit_length);
 
-  if (result)
-    synccom_port_execute_transmit(port, 0);
+  if (result) {
+    atomic_sub(transmit_length, &port->output_memory_usage);
+
+    /* Tell the port how much data is in this frame, then send it. */
+    synccom_transaction_add_write(transaction, 0, BC_FIFO_L_OFFSET, frame_size);
+    synccom_transaction_add_write(
+        transaction, 0, CMDR_OFFSET,
+        synccom_port_get_transmit_command(tx_modifiers));
+  }
 
-  dev_dbg(port->device, "F#%i => %i byte%s%s\n", frame->number, transmit_length,
+  dev_dbg(port->device, "F#%i => %i byte%s%s\n", number, transmit_length,
           (transmit_length == 1) ? "" : "s",
           (result == 2) ? " (finished)" : "");
 
   return result;
 }
 
+/*
+  Packs the frame, and as many queued frames after it as fit, back to back
+  into one of tx_buffers and sends them in a single transfer. Each frame is
+  padded out to four bytes, so the card sees the same data it would from
+  separate transfers, and gets its own BC_FIFO_L and transmit command writes
+  in the transaction. Returns 2 once the frames have been taken, or 0 if no
+  URB is free or the transfer couldn't be submitted. In that case the frame
+  is still the caller's and the frames packed after it are back at the front
+  of queued_oframes.
+*/
+unsigned synccom_port_transmit_frames(struct synccom_port *port,
+                                      struct synccom_frame *frame,
+                                      struct synccom_transaction *transaction) {
+  struct synccom_flist frames;
+  unsigned max_bytes = 0;
+  unsigned byte_count = 0;
+  unsigned length = 0;
+  unsigned slots = 0;
+  int result = 0;
+  int i = 0;
+
+  i = synccom_port_get_tx_urb(port);
+  if (i < 0)
+    return 0;
+
+  max_bytes = min_t(unsigned, port->tx_aggregate_bytes, TX_AGGREGATE_SIZE);
+  slots = (transaction->max_commands - transaction->num_commands) / 2;
+
+  synccom_flist_init(&frames);
+
+  do {
+    length = synccom_frame_get_length(frame);
+    memcpy(port->tx_buffers[i] + byte_count, frame->buffer, length);
+    memset(port->tx_buffers[i] + byte_count + length, 0, (4 - length % 4) % 4);
+    byte_count += length + (4 - length % 4) % 4;
+
+    synccom_flist_add_frame(&frames, frame);
+
+    if (--slots == 0 || byte_count >= max_bytes)
+      break;
+
+    spin_lock(&port->tx_spinlock);
+    frame = synccom_flist_remove_frame_if_lte(&port->queued_oframes,
+                                              max_bytes - byte_count);
+    spin_unlock(&port->tx_spinlock);
+  } while (frame);
+
+  result = synccom_port_submit_tx_urb(port, i, port->tx_buffers[i],
+                                      byte_count);
+  if (result) {
+    dev_err(port->device, "%s: couldn't send %i bytes (%i)\n", __func__,
+            byte_count, result);
+
+    /* Put everything back the way it was, in order. */
+    synccom_flist_remove_frame(&frames);
+
+    spin_lock(&port->tx_spinlock);
+    synccom_flist_splice_front(&port->queued_oframes, &frames);
+    spin_unlock(&port->tx_spinlock);
+
+    return 0;
+  }
+
+  atomic_sub(synccom_flist_calculate_memory_usage(&frames),
+             &port->output_memory_usage);
+
+  while ((frame = synccom_flist_remove_frame(&frames))) {
+    synccom_transaction_add_write(transaction, 0, BC_FIFO_L_OFFSET,
+                                  synccom_frame_get_frame_size(frame));
+    synccom_transaction_add_write(
+        transaction, 0, CMDR_OFFSET,
+        synccom_port_get_transmit_command(frame->tx_modifiers));
+
+    dev_dbg(port->device, "F#%i => %i byte%s (aggregated)\n", frame->number,
+            synccom_frame_get_length(frame),
+            (synccom_frame_get_length(frame) == 1) ? "" : "s");
+
+    synccom_frame_delete(frame);
+  }
+
+  return 2;
+}
+
 void program_synccom(struct synccom_port *port, char *line) {
-  int count;
-  char *msg = NULL;
+  unsigned char msg[50];
   int i;
-  msg = kmalloc(50, GFP_KERNEL);
+
   msg[0] = 0x06;
 
-  for (i = 0; line[i] != 13; i++) {
+  for (i = 0; line[i] != 13 && i + 1 < sizeof(msg); i++) {
     msg[i + 1] = line[i];
   }
 
-  usb_bulk_msg(port->udev, usb_sndbulkpipe(port->udev, 1), msg, i + 1, &count,
-               HZ * 10);
+  synccom_port_command(port, msg, i + 1, 0, 0, 0);
+}
+
+/*
+  Like synccom_port_transmit_frames, but packs the frames straight out of the
+  mmap()ed transmit ring so they never become synccom_frames. The data is
+  still copied once, into one of tx_buffers, as the ring's vmalloc()ed memory
+  can't be handed to the host controller. The descriptors are only handed
+  back once the transfer has been submitted. Returns 0 if no URB is free,
+  the next frame doesn't fit or the transfer couldn't be submitted, or 2 once
+  the frames have been taken.
+*/
+static unsigned
+synccom_port_transmit_ring_frames(struct synccom_port *port,
+                                  struct synccom_transaction *transaction) {
+  struct synccom_tx_desc descs[SYNCCOM_TRANSACTION_MAX_COMMANDS / 2];
+  unsigned byte_count = 0;
+  unsigned padding = 0;
+  unsigned slots = 0;
+  unsigned count = 0;
+  unsigned tail = 0;
+  unsigned j = 0;
+  int result = 0;
+  int number = 0;
+  int i = 0;
+
+  i = synccom_port_get_tx_urb(port);
+  if (i < 0)
+    return 0;
+
+  slots = (transaction->max_commands - transaction->num_commands) / 2;
+  slots = min_t(unsigned, slots, ARRAY_SIZE(descs));
+
+  spin_lock(&port->tx_spinlock);
+  while (count < slots && synccom_tx_mmap_peek(port, count, &descs[count])) {
+    padding = (4 - descs[count].length % 4) % 4;
+    if (byte_count + descs[count].length + padding > TX_AGGREGATE_SIZE)
+      break;
+
+    synccom_tx_mmap_copy(port, &descs[count],
+                         port->tx_buffers[i] + byte_count);
+    memset(port->tx_buffers[i] + byte_count + descs[count].length, 0,
+           padding);
+    byte_count += descs[count].length + padding;
+    count++;
+  }
+  tail = port->tx_mmap.tail;
+  spin_unlock(&port->tx_spinlock);
+
+  if (count == 0) {
+    synccom_port_put_tx_urb(port, port->tx_urbs[i]);
+    return 0;
+  }
+
+  result = synccom_port_submit_tx_urb(port, i, port->tx_buffers[i],
+                                      byte_count);
+  if (result) {
+    dev_err(port->device, "%s: couldn't send %i bytes (%i)\n", __func__,
+            byte_count, result);
+    return 0;
+  }
+
+  /* Unless a purge already threw them away. */
+  spin_lock(&port->tx_spinlock);
+  if (port->tx_mmap.tail == tail)
+    synccom_tx_mmap_consume(port, count);
+  spin_unlock(&port->tx_spinlock);
+
+  for (j = 0; j < count; j++) {
+    synccom_transaction_add_write(transaction, 0, BC_FIFO_L_OFFSET,
+                                  descs[j].length);
+    synccom_transaction_add_write(
+        transaction, 0, CMDR_OFFSET,
+        synccom_port_get_transmit_command(descs[j].tx_modifiers));
+
+    number = atomic_inc_return(&port->tx_sequence);
 
-  kfree(msg);
+    dev_dbg(port->device, "F#%i => %i byte%s (ring)\n", number,
+            descs[j].length, (descs[j].length == 1) ? "" : "s");
+  }
+
+  return 2;
 }
 
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0)
-void timer_handler(unsigned long data) {
-  struct synccom_port *port = (struct synccom_port *)data;
-#else
-void timer_handler(struct timer_list *t) {
-  struct synccom_port *port = from_timer(port, t, timer);
-#endif
-  tasklet_schedule(&port->send_oframe_tasklet);
+static void oframe_transaction_callback(struct synccom_transaction *transaction) {
+  if (transaction->status)
+    dev_dbg(transaction->port->device, "%s: transmit commands failed (%i)\n",
+            __func__, transaction->status);
 }
 
-void oframe_worker(unsigned long data) {
+/*
+  Transmit pump. Runs on synccom_workqueue so it is free to sleep, and sends
+  every queued frame it can per run. The data goes straight out while the
+  BC_FIFO_L/XF writes for all of the frames are sent as asynchronous register
+  transactions. With tx_aggregate_bytes set, frames that fit are packed
+  several to a transfer. Frames in the mmap()ed transmit ring go out once
+  the queue is empty. Frames left over once all of the transmit URBs are
+  busy get picked up when write_data_callback() queues the pump again.
+
+  register_access_mutex is held from getting each transaction until it has
+  been queued. Transactions run in the order they are queued, and the
+  sequences that hold the mutex execute theirs before letting go, so the
+  BC_FIFO_L/CMDR writes never land in the middle of one.
+*/
+void oframe_worker(struct work_struct *work) {
   struct synccom_port *port = 0;
+  struct synccom_transaction *transaction = 0;
+  struct synccom_frame *frame = 0;
+  unsigned sent = 0;
   int result = 0;
 
-  unsigned long board_flags = 0;
-  unsigned long frame_flags = 0;
-  unsigned long queued_flags = 0;
-
-  port = (struct synccom_port *)data;
+  port = container_of(to_delayed_work(work), struct synccom_port,
+                      send_oframe_worker);
 
   return_if_untrue(port);
 
-  spin_lock_irqsave(&port->board_tx_spinlock, board_flags);
-  spin_lock_irqsave(&port->pending_oframe_spinlock, frame_flags);
+  for (;;) {
+    /* Take the frame left over from last time, or the next queued one. The
+       pump owns it until it is handed off or put back. */
+    spin_lock(&port->tx_spinlock);
+    frame = port->pending_oframe;
+    port->pending_oframe = 0;
+    if (!frame)
+      frame = synccom_flist_remove_frame(&port->queued_oframes);
+    spin_unlock(&port->tx_spinlock);
 
-  /* Check if exists and if so, grabs the frame to transmit. */
-  if (!port->pending_oframe) {
-    spin_lock_irqsave(&port->queued_oframes_spinlock, queued_flags);
-    port->pending_oframe = synccom_flist_remove_frame(&port->queued_oframes);
-    spin_unlock_irqrestore(&port->queued_oframes_spinlock, queued_flags);
+    if (!frame)
+      frame = synccom_tx_mmap_remove_frame_if_gt(port, TX_AGGREGATE_SIZE);
 
-    /* No frames in queue to transmit */
-    if (!port->pending_oframe) {
-      spin_unlock_irqrestore(&port->pending_oframe_spinlock, frame_flags);
-      spin_unlock_irqrestore(&port->board_tx_spinlock, board_flags);
-      return;
+    /* No frames in queue or in the transmit ring to transmit */
+    if (!frame && !synccom_tx_mmap_has_frames(port))
+      break;
+
+    if (transaction &&
+        transaction->max_commands - transaction->num_commands < 2) {
+      synccom_transaction_submit(transaction, oframe_transaction_callback, 0);
+      mutex_unlock(&port->register_access_mutex);
+      transaction = 0;
     }
-  }
 
-  result = synccom_port_transmit_frame(port, port->pending_oframe);
+    if (!transaction) {
+      mutex_lock(&port->register_access_mutex);
+      transaction = synccom_transaction_get(port);
+      if (!transaction)
+        mutex_unlock(&port->register_access_mutex);
+    }
 
-  if (result == 2) {
-    synccom_frame_delete(port->pending_oframe);
-    port->pending_oframe = 0;
+    if (!transaction)
+      result = 0;
+    else if (!frame)
+      result = synccom_port_transmit_ring_frames(port, transaction);
+    else if (port->tx_aggregate_bytes &&
+             synccom_frame_get_length(frame) <=
+                 min_t(unsigned, port->tx_aggregate_bytes, TX_AGGREGATE_SIZE))
+      result = synccom_port_transmit_frames(port, frame, transaction);
+    else
+      result = synccom_port_transmit_frame(port, frame, transaction);
+
+    /* Otherwise the frame now belongs to its URB. */
+    if (result != 2) {
+      spin_lock(&port->tx_spinlock);
+      port->pending_oframe = frame;
+      spin_unlock(&port->tx_spinlock);
+      break;
+    }
+
+    sent++;
   }
 
-  spin_unlock_irqrestore(&port->pending_oframe_spinlock, frame_flags);
-  spin_unlock_irqrestore(&port->board_tx_spinlock, board_flags);
+  if (transaction) {
+    if (transaction->num_commands)
+      synccom_transaction_submit(transaction, oframe_transaction_callback, 0);
+    else
+      synccom_transaction_put(transaction);
 
-  if (result) {
-    wake_up_interruptible(&port->output_queue);
-    tasklet_schedule(&port->send_oframe_tasklet);
+    mutex_unlock(&port->register_access_mutex);
   }
+
+  if (sent)
+    wake_up_interruptible(&port->output_queue);
 }
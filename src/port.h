@@ -25,16 +25,21 @@ THE SOFTWARE.
 
 #include <linux/cdev.h> /* struct cdev */
 #include <linux/completion.h>
+#include <linux/hrtimer.h> /* struct hrtimer */
 #include <linux/fs.h>        /* Needed to build on older kernel version */
 #include <linux/interrupt.h> /* struct tasklet_struct */
 #include <linux/version.h>   /* LINUX_VERSION_CODE, KERNEL_VERSION */
+#include <linux/workqueue.h> /* struct delayed_work */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 26)
 #include <linux/semaphore.h> /* struct semaphore */
 #endif
 #include "debug.h"      /* stuct debug_interrupt_tracker */
 #include "descriptor.h" /* struct synccom_descriptor */
 #include "flist.h"      /* struct synccom_registers */
+#include "mmap.h"       /* struct synccom_rx_mmap */
+#include "ring.h"       /* struct synccom_ring */
 #include "synccom.h"    /* struct synccom_registers */
+#include "transaction.h" /* struct synccom_transaction */
 #include <linux/usb.h>
 
 #define FCR_OFFSET 0x40
@@ -94,9 +99,6 @@ THE SOFTWARE.
 
 #define CE_BIT 0x00040000
 
-#define NUMBER_OF_URBS 8
-#define URB_BUFFER_SIZE 512
-
 #define REGISTER_WRITE_ENDPOINT 0x01
 #define REGISTER_READ_ENDPOINT 0x81
 #define DATA_WRITE_ENDPOINT 0x06
@@ -104,6 +106,11 @@ THE SOFTWARE.
 
 #define FIRST_NONVOLATILE_VERSION 0x110
 
+#define WRITES_IN_FLIGHT 8 /* arbitrarily chosen */
+#define TX_AGGREGATE_SIZE 8192 /* largest transfer tx_buffers can hold */
+#define FRAME_BUFFER_CLASSES 3 /* see synccom_frame_get_buffer() */
+#define FRAME_BUFFER_CACHE_DEPTH 16 /* free buffers kept per class */
+
 // These are defined in the firmware, so shouldn't be changed unless you are 100% sure
 // you know what you are doing.
 #define SYNCCOM_READ_FX2_FIRMWARE	0x02 // write: 0x02
@@ -122,6 +129,8 @@ THE SOFTWARE.
 
 
 
+extern struct workqueue_struct *synccom_workqueue;
+
 struct synccom_port {
   struct list_head list;
   dev_t dev_t;
@@ -135,22 +144,22 @@ struct synccom_port {
   /* Prevents simultaneous read(), write() and poll() calls. */
   struct semaphore read_semaphore;
   struct semaphore write_semaphore;
-  struct semaphore poll_semaphore;
 
   wait_queue_head_t input_queue;
   wait_queue_head_t output_queue;
 
   struct synccom_flist
       queued_iframes; /* Frames already retrieved from the FIFO */
-  struct synccom_flist pending_iframes;
   struct synccom_flist queued_oframes; /* Frames not yet in the FIFO yet */
 
-  struct synccom_frame *pending_iframe; /* Frame retrieving from the FIFO */
   struct synccom_frame *pending_oframe; /* Frame being put in the FIFO */
-  struct synccom_frame *istream;        /* Transparent stream */
-  struct synccom_frame *data_chunks;    /* Temporary data storage */
+  struct synccom_ring istream;          /* Raw receive stream */
+  struct synccom_rx_mmap rx_mmap;       /* istream shared through mmap() */
+  struct synccom_tx_mmap tx_mmap;       /* Frames written through mmap() */
 
-  struct synccom_registers register_storage; /* Only valid on suspend/resume */
+  /* Shadow of the card's registers, see is_cacheable_register */
+  struct synccom_registers register_storage;
+  __u32 stale_registers; /* register_storage entries to re-read, by index */
   struct synccom_memory_cap memory_cap;
 
   __u32 last_isr_value;
@@ -158,36 +167,72 @@ struct synccom_port {
   unsigned append_timestamp;
   unsigned ignore_timeout;
   unsigned rx_multiple;
+  unsigned rx_coalesce_bytes;
+  unsigned rx_coalesce_usecs;
+  unsigned rx_watermark_bytes;
+  unsigned rx_watermark_usecs;
+  unsigned tx_aggregate_bytes;
+  unsigned tx_aggregate_usecs;
+  atomic_t output_memory_usage; /* Written bytes not yet handed to a URB */
+  atomic_t rx_sequence; /* Last received frame number */
+  atomic_t tx_sequence; /* Last written frame number */
   int tx_modifiers;
   __u32 fx2_rev;
 
-  spinlock_t board_rx_spinlock; /* Anything that will alter the state of rx at a
-                                   board level */
-  spinlock_t board_tx_spinlock; /* Anything that will alter the state of rx at a
-                                   board level */
-
-  spinlock_t istream_spinlock;
-  spinlock_t pending_iframe_spinlock;
-  spinlock_t pending_oframe_spinlock;
-  spinlock_t queued_oframes_spinlock;
-  spinlock_t queued_iframes_spinlock;
-  spinlock_t pending_iframes_spinlock;
+  /*
+    Locking, outermost first:
+      running_bc_mutex
+      read_semaphore, write_semaphore
+      register_access_mutex
+      a transaction from the pool (synccom_transaction_get)
+      rx_spinlock (queued_iframes and rx_mmap) or tx_spinlock
+        (queued_oframes, pending_oframe and tx_mmap), never both
+      frame_buffer_spinlock, transaction_spinlock
+
+    rx_spinlock and tx_spinlock are only taken in process context, so they
+    don't disable interrupts. The URB callbacks never take them: istream is
+    a lock free single producer/single consumer ring, and memory usage is
+    read from istream and output_memory_usage.
+  */
+  spinlock_t rx_spinlock;
+  spinlock_t tx_spinlock;
   struct mutex io_mutex; /* synchronize I/O with disconnect */
   struct mutex running_bc_mutex;
   struct mutex register_access_mutex;
 
-  struct tasklet_struct send_oframe_tasklet;
-  struct timer_list timer;
-  struct work_struct bclist_worker;
+  /* Register access engine, see transaction.c */
+  struct synccom_transaction *transactions;
+  struct list_head free_transactions;
+  struct list_head queued_transactions;
+  struct synccom_transaction *active_transaction;
+  spinlock_t transaction_spinlock;
+  wait_queue_head_t transaction_queue;
+
+  /* Recycled frame buffers, see frame.c */
+  struct list_head free_frame_buffers[FRAME_BUFFER_CLASSES];
+  unsigned free_frame_buffer_count[FRAME_BUFFER_CLASSES];
+  spinlock_t frame_buffer_spinlock;
+
+  struct delayed_work send_oframe_worker;
+  struct delayed_work bclist_worker;
+  atomic_t bclist_pending_bytes; /* Frame data received since the last run */
+  struct hrtimer rx_watermark_timer; /* Wakes streaming readers late */
+  unsigned initialized; /* initialize() set up the locks, workers and timer */
 
   /***************************usb structure***********************/
   struct usb_device *udev;         /* the usb device for this device */
   struct usb_interface *interface; /* the interface for this device */
-  struct semaphore limit_sem;
-      /* limiting the number of writes in progress */ // TODO is this necessary?
+  struct semaphore limit_sem; /* limiting the number of writes in progress */
   struct usb_anchor submitted; /* in case we need to retract our submissions */
+  struct urb *tx_urbs[WRITES_IN_FLIGHT];
+  struct synccom_frame *tx_frames[WRITES_IN_FLIGHT]; /* 0 if aggregated */
+  unsigned char *tx_buffers[WRITES_IN_FLIGHT];       /* for aggregation */
+  unsigned long tx_urbs_busy; /* bit per tx_urbs entry */
   struct urb **bulk_in_urbs;
   unsigned char **bulk_in_buffers;
+  unsigned rx_urb_count;   /* number of bulk_in_urbs */
+  unsigned rx_urb_size;    /* bytes per bulk_in_buffers entry */
+  unsigned rx_packet_size; /* wMaxPacketSize of DATA_READ_ENDPOINT */
 
   /* the buffer to receive data */
   size_t bulk_in_size;        /* the size of the receive buffer */
@@ -210,9 +255,14 @@ struct synccom_port {
 int initialize(struct synccom_port *port);
 void program_synccom(struct synccom_port *port, char *line);
 
-int synccom_port_write(struct synccom_port *port, const char *data,
-                       unsigned length);
-ssize_t synccom_port_read(struct synccom_port *port, char *buf, size_t count);
+int synccom_port_write(struct synccom_port *port, struct iov_iter *from,
+                       gfp_t malloc_flags);
+int synccom_port_write_frames(struct synccom_port *port,
+                              const struct synccom_write_frame *frames,
+                              unsigned count);
+ssize_t synccom_port_read(struct synccom_port *port, struct iov_iter *to);
+int synccom_port_read_frame(struct synccom_port *port,
+                            struct synccom_frame_info *info);
 
 unsigned synccom_port_has_iframes(struct synccom_port *port, unsigned lock);
 unsigned synccom_port_has_oframes(struct synccom_port *port, unsigned lock);
@@ -246,8 +296,13 @@ unsigned synccom_port_get_input_memory_usage(struct synccom_port *port);
 
 unsigned synccom_port_get_input_memory_cap(struct synccom_port *port);
 unsigned synccom_port_get_output_memory_cap(struct synccom_port *port);
-void synccom_port_set_memory_cap(struct synccom_port *port,
-                                 struct synccom_memory_cap *memory_cap);
+int synccom_port_set_memory_cap(struct synccom_port *port,
+                                struct synccom_memory_cap *memory_cap);
+
+int synccom_port_set_rx_urbs(struct synccom_port *port,
+                             struct synccom_rx_urbs *value);
+void synccom_port_get_rx_urbs(struct synccom_port *port,
+                              struct synccom_rx_urbs *value);
 
 void synccom_port_set_clock_bits(struct synccom_port *port,
                                  unsigned char *clock_data);
@@ -260,6 +315,25 @@ void synccom_port_set_rx_multiple(struct synccom_port *port,
                                   unsigned rx_multiple);
 unsigned synccom_port_get_rx_multiple(struct synccom_port *port);
 
+void synccom_port_set_rx_coalesce_bytes(struct synccom_port *port,
+                                        unsigned value);
+unsigned synccom_port_get_rx_coalesce_bytes(struct synccom_port *port);
+void synccom_port_set_rx_coalesce_usecs(struct synccom_port *port,
+                                        unsigned value);
+unsigned synccom_port_get_rx_coalesce_usecs(struct synccom_port *port);
+void synccom_port_set_rx_watermark_bytes(struct synccom_port *port,
+                                         unsigned value);
+unsigned synccom_port_get_rx_watermark_bytes(struct synccom_port *port);
+void synccom_port_set_rx_watermark_usecs(struct synccom_port *port,
+                                         unsigned value);
+unsigned synccom_port_get_rx_watermark_usecs(struct synccom_port *port);
+void synccom_port_set_tx_aggregate_bytes(struct synccom_port *port,
+                                         unsigned value);
+unsigned synccom_port_get_tx_aggregate_bytes(struct synccom_port *port);
+void synccom_port_set_tx_aggregate_usecs(struct synccom_port *port,
+                                         unsigned value);
+unsigned synccom_port_get_tx_aggregate_usecs(struct synccom_port *port);
+
 int synccom_port_set_append_status(struct synccom_port *port, unsigned value);
 unsigned synccom_port_get_append_status(struct synccom_port *port);
 
@@ -271,9 +345,16 @@ int synccom_port_set_registers(struct synccom_port *port,
                                const struct synccom_registers *regs);
 void synccom_port_get_registers(struct synccom_port *port,
                                 struct synccom_registers *regs);
+int synccom_port_refresh_registers(struct synccom_port *port);
+int synccom_port_execute_register_ops(struct synccom_port *port,
+                                      struct synccom_register_op *ops,
+                                      unsigned count);
 
 unsigned synccom_port_is_streaming(struct synccom_port *port);
 unsigned synccom_port_has_incoming_data(struct synccom_port *port);
+void synccom_port_start_rx(struct synccom_port *port);
+void synccom_port_stop_rx(struct synccom_port *port);
+void synccom_port_kick_oframe_worker(struct synccom_port *port);
 
 unsigned synccom_port_can_support_nonvolatile(struct synccom_port *port);
 __u32 synccom_port_get_fx2(struct synccom_port *port, int need_lock);
@@ -287,20 +368,20 @@ void synccom_port_increment_interrupt_counts(struct synccom_port *port,
                                              __u32 isr_value);
 #endif /* DEBUG */
 
+unsigned synccom_port_is_valid_tx_modifiers(int value);
 int synccom_port_set_tx_modifiers(struct synccom_port *port, int tx_modifiers);
 unsigned synccom_port_get_tx_modifiers(struct synccom_port *port);
 void synccom_port_execute_transmit(struct synccom_port *port, unsigned dma);
 
-void synccom_port_reset_timer(struct synccom_port *port);
 unsigned synccom_port_transmit_frame(struct synccom_port *port,
-                                     struct synccom_frame *frame);
-void oframe_worker(unsigned long data);
+                                     struct synccom_frame *frame,
+                                     struct synccom_transaction *transaction);
+unsigned synccom_port_transmit_frames(struct synccom_port *port,
+                                      struct synccom_frame *frame,
+                                      struct synccom_transaction *transaction);
+void oframe_worker(struct work_struct *work);
 int synccom_port_create_urbs(struct synccom_port *port);
 int synccom_port_destroy_urbs(struct synccom_port *port);
-
-#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 14, 0)
-void timer_handler(unsigned long data);
-#else
-void timer_handler(struct timer_list *t);
-#endif
+int synccom_port_create_tx_urbs(struct synccom_port *port);
+void synccom_port_destroy_tx_urbs(struct synccom_port *port);
 #endif
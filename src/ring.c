@@ -0,0 +1,383 @@
+/*
+Copyright 2022 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <linux/log2.h>    /* roundup_pow_of_two */
+#include <linux/uaccess.h> /* copy_to_user */
+#include <linux/uio.h>     /* copy_to_iter */
+#include <linux/version.h> /* LINUX_VERSION_CODE, KERNEL_VERSION */
+#include <linux/vmalloc.h> /* vmalloc, vfree */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h> /* get_unaligned, put_unaligned */
+#else
+#include <asm/unaligned.h> /* get_unaligned, put_unaligned */
+#endif
+
+#include "port.h" /* struct synccom_port */
+#include "ring.h"
+#include "utils.h" /* return_{val_}if_untrue */
+
+#define SYNCCOM_RING_MIN_SIZE 4096
+
+static unsigned synccom_ring_round_size(unsigned size) {
+  if (size < SYNCCOM_RING_MIN_SIZE)
+    return SYNCCOM_RING_MIN_SIZE;
+
+  /* Larger than the biggest power of two an unsigned can hold. */
+  if (size > (1U << 31))
+    return 0;
+
+  return roundup_pow_of_two(size);
+}
+
+int synccom_ring_init(struct synccom_ring *ring, struct synccom_port *port,
+                      unsigned size) {
+  return_val_if_untrue(ring, 0);
+
+  ring->port = port;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->external = 0;
+  ring->size = synccom_ring_round_size(size);
+  ring->buffer = (ring->size) ? vmalloc(ring->size) : 0;
+
+  if (!ring->buffer) {
+    dev_err(port->device, "%s - not enough memory for %u byte ring\n",
+            __func__, size);
+    ring->size = 0;
+    return 0;
+  }
+
+  return 1;
+}
+
+void synccom_ring_delete(struct synccom_ring *ring) {
+  return_if_untrue(ring);
+
+  if (!ring->external)
+    vfree(ring->buffer);
+
+  ring->buffer = 0;
+  ring->external = 0;
+  ring->size = 0;
+  ring->head = 0;
+  ring->tail = 0;
+}
+
+/*
+  Both the producer and the consumer have to be stopped while resizing. Fails
+  without touching the ring if the data it holds wouldn't fit, as the frame
+  lengths queued for that data would no longer match it.
+*/
+int synccom_ring_resize(struct synccom_ring *ring, unsigned size) {
+  unsigned char *new_buffer = 0;
+  unsigned new_size = 0;
+  unsigned length = 0;
+  unsigned offset = 0;
+  unsigned first = 0;
+
+  return_val_if_untrue(ring, 0);
+
+  new_size = synccom_ring_round_size(size);
+  if (new_size == ring->size)
+    return 1;
+
+  if (synccom_ring_get_length(ring) > new_size)
+    return 0;
+
+  new_buffer = (new_size) ? vmalloc(new_size) : 0;
+  if (!new_buffer) {
+    dev_err(ring->port->device, "%s - not enough memory for %u byte ring\n",
+            __func__, size);
+    return 0;
+  }
+
+  length = synccom_ring_get_length(ring);
+  offset = ring->tail & (ring->size - 1);
+  first = min(length, ring->size - offset);
+
+  memcpy(new_buffer, ring->buffer + offset, first);
+  memcpy(new_buffer + first, ring->buffer, length - first);
+
+  if (!ring->external)
+    vfree(ring->buffer);
+
+  ring->buffer = new_buffer;
+  ring->external = 0;
+  ring->size = new_size;
+  ring->tail = 0;
+  ring->head = length;
+
+  return 1;
+}
+
+/*
+  Copies the ring into buffer, which has to be at least ring->size bytes and
+  stays owned by the caller. Neither side can be running.
+*/
+void synccom_ring_move_buffer(struct synccom_ring *ring,
+                              unsigned char *buffer) {
+  return_if_untrue(ring);
+  return_if_untrue(buffer);
+
+  memcpy(buffer, ring->buffer, ring->size);
+
+  if (!ring->external)
+    vfree(ring->buffer);
+
+  ring->buffer = buffer;
+  ring->external = 1;
+}
+
+unsigned synccom_ring_get_length(struct synccom_ring *ring) {
+  return_val_if_untrue(ring, 0);
+
+  return smp_load_acquire(&ring->head) - smp_load_acquire(&ring->tail);
+}
+
+/* Consumer side. Where the unconsumed data starts, free running. */
+unsigned synccom_ring_get_tail(struct synccom_ring *ring) {
+  return_val_if_untrue(ring, 0);
+
+  return ring->tail;
+}
+
+unsigned synccom_ring_get_space(struct synccom_ring *ring) {
+  return_val_if_untrue(ring, 0);
+
+  return ring->size - synccom_ring_get_length(ring);
+}
+
+unsigned synccom_ring_get_size(struct synccom_ring *ring) {
+  return_val_if_untrue(ring, 0);
+
+  return ring->size;
+}
+
+unsigned synccom_ring_is_empty(struct synccom_ring *ring) {
+  return synccom_ring_get_length(ring) == 0;
+}
+
+/* Producer side. Either all of the data is added or none of it is. */
+int synccom_ring_add_data(struct synccom_ring *ring, const char *data,
+                          unsigned length) {
+  unsigned head = 0;
+  unsigned tail = 0;
+  unsigned offset = 0;
+  unsigned first = 0;
+
+  return_val_if_untrue(ring, 0);
+  return_val_if_untrue(length > 0, 0);
+
+  head = ring->head;
+  tail = smp_load_acquire(&ring->tail);
+
+  if (length > ring->size - (head - tail))
+    return 0;
+
+  offset = head & (ring->size - 1);
+  first = min(length, ring->size - offset);
+
+  memcpy(ring->buffer + offset, data, first);
+  memcpy(ring->buffer, data + first, length - first);
+
+  /* Publish the data before the consumer can see the new head. */
+  smp_store_release(&ring->head, head + length);
+
+  return 1;
+}
+
+/*
+  Copies data[start .. start + count) to destination with every 16 bit pair
+  swapped, i.e. destination byte k comes from data[k ^ 1]. Pairs are counted
+  from data, so an odd length reads the byte after the last one.
+
+  Whole words are swapped at once by moving the even and odd bytes of every
+  pair past each other, which works the same on either endianness.
+*/
+static void synccom_ring_copy_swab16(unsigned char *destination,
+                                     const unsigned char *data, unsigned start,
+                                     unsigned count) {
+  const unsigned long mask = (~0UL / 0xffff) * 0x00ff;
+  unsigned long value = 0;
+
+  if (count && (start & 1)) {
+    *destination++ = data[start - 1];
+    start++;
+    count--;
+  }
+
+  for (; count >= sizeof(value); count -= sizeof(value)) {
+    value = get_unaligned((const unsigned long *)(data + start));
+    value = ((value & mask) << 8) | ((value >> 8) & mask);
+    put_unaligned(value, (unsigned long *)destination);
+
+    destination += sizeof(value);
+    start += sizeof(value);
+  }
+
+  for (; count >= 2; count -= 2) {
+    *destination++ = data[start + 1];
+    *destination++ = data[start];
+    start += 2;
+  }
+
+  if (count)
+    *destination = data[start + 1];
+}
+
+/*
+  Producer side. Same as synccom_ring_add_data but undoes the byte order of
+  the 16 bit words the device sends while copying, so the data is only
+  touched once.
+*/
+int synccom_ring_add_data_swab16(struct synccom_ring *ring,
+                                 const unsigned char *data, unsigned length) {
+  unsigned head = 0;
+  unsigned tail = 0;
+  unsigned offset = 0;
+  unsigned first = 0;
+
+  return_val_if_untrue(ring, 0);
+  return_val_if_untrue(length > 0, 0);
+
+  head = ring->head;
+  tail = smp_load_acquire(&ring->tail);
+
+  if (length > ring->size - (head - tail))
+    return 0;
+
+  offset = head & (ring->size - 1);
+  first = min(length, ring->size - offset);
+
+  synccom_ring_copy_swab16(ring->buffer + offset, data, 0, first);
+  synccom_ring_copy_swab16(ring->buffer, data, first, length - first);
+
+  smp_store_release(&ring->head, head + length);
+
+  return 1;
+}
+
+/* Consumer side. A NULL destination discards the data. */
+int synccom_ring_remove_data(struct synccom_ring *ring, char *destination,
+                             unsigned length) {
+  unsigned head = 0;
+  unsigned tail = 0;
+  unsigned offset = 0;
+  unsigned first = 0;
+
+  return_val_if_untrue(ring, 0);
+
+  if (length == 0)
+    return 1;
+
+  tail = ring->tail;
+  head = smp_load_acquire(&ring->head);
+
+  if (head == tail) {
+    dev_warn(ring->port->device,
+             "%s - attempting data removal from empty ring\n", __func__);
+    return 1;
+  }
+
+  length = min(length, head - tail);
+  offset = tail & (ring->size - 1);
+  first = min(length, ring->size - offset);
+
+  if (destination) {
+    if (copy_to_user(destination, ring->buffer + offset, first))
+      return 0;
+
+    if (copy_to_user(destination + first, ring->buffer, length - first))
+      return 0;
+  }
+
+  /* Don't let the producer reuse the space until we are done reading it. */
+  smp_store_release(&ring->tail, tail + length);
+
+  return 1;
+}
+
+/* Consumer side. Same as synccom_ring_remove_data, for read_iter(). */
+int synccom_ring_remove_data_iter(struct synccom_ring *ring,
+                                  struct iov_iter *destination,
+                                  unsigned length) {
+  unsigned head = 0;
+  unsigned tail = 0;
+  unsigned offset = 0;
+  unsigned first = 0;
+
+  return_val_if_untrue(ring, 0);
+  return_val_if_untrue(destination, 0);
+
+  if (length == 0)
+    return 1;
+
+  tail = ring->tail;
+  head = smp_load_acquire(&ring->head);
+
+  length = min(length, head - tail);
+  offset = tail & (ring->size - 1);
+  first = min(length, ring->size - offset);
+
+  if (copy_to_iter(ring->buffer + offset, first, destination) != first)
+    return 0;
+
+  if (copy_to_iter(ring->buffer, length - first, destination) !=
+      length - first)
+    return 0;
+
+  smp_store_release(&ring->tail, tail + length);
+
+  return 1;
+}
+
+/* Consumer side. Copies into kernel memory without consuming anything. */
+int synccom_ring_peek_data(struct synccom_ring *ring, unsigned skip,
+                           char *destination, unsigned length) {
+  unsigned head = 0;
+  unsigned tail = 0;
+  unsigned offset = 0;
+  unsigned first = 0;
+
+  return_val_if_untrue(ring, 0);
+
+  tail = ring->tail;
+  head = smp_load_acquire(&ring->head);
+
+  if (skip + length > head - tail)
+    return 0;
+
+  offset = (tail + skip) & (ring->size - 1);
+  first = min(length, ring->size - offset);
+
+  memcpy(destination, ring->buffer + offset, first);
+  memcpy(destination + first, ring->buffer, length - first);
+
+  return 1;
+}
+
+/* Consumer side. Drops everything the producer has published so far. */
+void synccom_ring_clear(struct synccom_ring *ring) {
+  return_if_untrue(ring);
+
+  smp_store_release(&ring->tail, smp_load_acquire(&ring->head));
+}
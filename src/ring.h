@@ -0,0 +1,74 @@
+/*
+Copyright 2022 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SYNCCOM_RING_H
+#define SYNCCOM_RING_H
+
+#include <linux/uio.h> /* struct iov_iter */
+#include <linux/version.h>
+
+struct synccom_port;
+
+/*
+  Single producer, single consumer byte ring used for the receive stream.
+
+  The producer (read_data_callback) only ever advances head and the consumer
+  (the read paths) only ever advances tail, so neither side needs a lock. Both
+  indexes run freely and are masked on access, which requires the size to be a
+  power of two.
+
+  The buffer can be handed over to someone else (the mmap()ed receive ring),
+  after which the ring no longer frees it.
+*/
+struct synccom_ring {
+  unsigned char *buffer;
+  unsigned size;
+  unsigned head;
+  unsigned tail;
+  unsigned external;
+  struct synccom_port *port;
+};
+
+int synccom_ring_init(struct synccom_ring *ring, struct synccom_port *port,
+                      unsigned size);
+void synccom_ring_delete(struct synccom_ring *ring);
+int synccom_ring_resize(struct synccom_ring *ring, unsigned size);
+void synccom_ring_move_buffer(struct synccom_ring *ring, unsigned char *buffer);
+unsigned synccom_ring_get_length(struct synccom_ring *ring);
+unsigned synccom_ring_get_tail(struct synccom_ring *ring);
+unsigned synccom_ring_get_space(struct synccom_ring *ring);
+unsigned synccom_ring_get_size(struct synccom_ring *ring);
+unsigned synccom_ring_is_empty(struct synccom_ring *ring);
+int synccom_ring_add_data(struct synccom_ring *ring, const char *data,
+                          unsigned length);
+int synccom_ring_add_data_swab16(struct synccom_ring *ring,
+                                 const unsigned char *data, unsigned length);
+int synccom_ring_remove_data(struct synccom_ring *ring, char *destination,
+                             unsigned length);
+int synccom_ring_remove_data_iter(struct synccom_ring *ring,
+                                  struct iov_iter *destination,
+                                  unsigned length);
+int synccom_ring_peek_data(struct synccom_ring *ring, unsigned skip,
+                           char *destination, unsigned length);
+void synccom_ring_clear(struct synccom_ring *ring);
+
+#endif
@@ -30,6 +30,7 @@ THE SOFTWARE.
   memset(&registers, -1, sizeof(registers))
 #define SYNCCOM_MEMORY_CAP_INIT(memory_cap)                                    \
   memset(&memory_cap, -1, sizeof(memory_cap))
+#define SYNCCOM_RX_URBS_INIT(rx_urbs) memset(&rx_urbs, -1, sizeof(rx_urbs))
 #define SYNCCOM_UPDATE_VALUE -2
 
 #define SYNCCOM_IOCTL_MAGIC 0x18
@@ -78,6 +79,33 @@ THE SOFTWARE.
 
 #define SYNCCOM_GET_FX2_FIRMWARE _IOR(SYNCCOM_IOCTL_MAGIC, 31, unsigned *)
 
+#define SYNCCOM_SET_RX_URBS                                                    \
+  _IOW(SYNCCOM_IOCTL_MAGIC, 32, struct synccom_rx_urbs *)
+#define SYNCCOM_GET_RX_URBS                                                    \
+  _IOR(SYNCCOM_IOCTL_MAGIC, 33, struct synccom_rx_urbs *)
+
+#define SYNCCOM_REG_BATCH                                                      \
+  _IOWR(SYNCCOM_IOCTL_MAGIC, 34, struct synccom_register_batch *)
+
+#define SYNCCOM_REFRESH_REGISTERS _IO(SYNCCOM_IOCTL_MAGIC, 35)
+
+#define SYNCCOM_READ_FRAME                                                     \
+  _IOWR(SYNCCOM_IOCTL_MAGIC, 36, struct synccom_frame_info *)
+
+#define SYNCCOM_READ_FRAMES                                                    \
+  _IOWR(SYNCCOM_IOCTL_MAGIC, 37, struct synccom_read_frames *)
+
+#define SYNCCOM_WRITE_FRAMES                                                   \
+  _IOW(SYNCCOM_IOCTL_MAGIC, 38, struct synccom_write_frames *)
+
+#define SYNCCOM_GET_RX_RING                                                    \
+  _IOR(SYNCCOM_IOCTL_MAGIC, 39, struct synccom_mmap_info *)
+
+#define SYNCCOM_GET_TX_RING                                                    \
+  _IOR(SYNCCOM_IOCTL_MAGIC, 40, struct synccom_mmap_info *)
+
+#define SYNCCOM_TX_RING_DOORBELL _IO(SYNCCOM_IOCTL_MAGIC, 41)
+
 enum transmit_modifiers { XF = 0, XREP = 1, TXT = 2, TXEXT = 4 };
 typedef __s64 synccom_register;
 
@@ -119,6 +147,101 @@ struct synccom_memory_cap {
   int output;
 };
 
+struct synccom_rx_urbs {
+  int count; /* URBs kept in flight on the data endpoint */
+  int size;  /* Bytes per URB, rounded up to whole packets */
+};
+
+#define SYNCCOM_REGISTER_READ 0
+#define SYNCCOM_REGISTER_WRITE 1
+
+#define SYNCCOM_MAX_REGISTER_OPS 256
+
+struct synccom_register_op {
+  __u32 bar;
+  __u32 offset;
+  __u32 op;
+  __u32 value; /* Written value, or the value read back */
+  __u32 reserved; /* Must be 0 */
+};
+
+struct synccom_register_batch {
+  __u64 ops; /* struct synccom_register_op * */
+  __u32 count;
+  __u32 reserved;
+};
+
+struct synccom_frame_info {
+  __u64 buffer; /* char * */
+  __u32 buffer_size;
+  __u32 length;   /* Frame data copied into buffer */
+  __u32 status;   /* The frame's two status bytes */
+  __u32 sequence; /* Counts up by one per received frame */
+  __s64 timestamp_sec;
+  __u32 timestamp_nsec;
+  __u32 reserved;
+};
+
+struct synccom_read_frames {
+  __u64 frames; /* struct synccom_frame_info * */
+  __u32 count;  /* Entries in frames, then the number filled in */
+  __u32 reserved;
+};
+
+#define SYNCCOM_MAX_WRITE_FRAMES 1024
+
+struct synccom_write_frame {
+  __u64 buffer; /* const char * */
+  __u32 length;
+  __s32 tx_modifiers; /* -1 for the port's tx_modifiers */
+};
+
+struct synccom_write_frames {
+  __u64 frames; /* struct synccom_write_frame * */
+  __u32 count;
+  __u32 reserved;
+};
+
+/* mmap() offsets of the receive and transmit rings. */
+#define SYNCCOM_RX_RING_OFFSET 0
+#define SYNCCOM_TX_RING_OFFSET 0x100000
+
+struct synccom_mmap_info {
+  __u32 size;        /* Bytes to mmap() */
+  __u32 desc_offset; /* Of the descriptors, from the start of the mapping */
+  __u32 desc_count;  /* A power of two */
+  __u32 data_offset; /* Of the data area, from the start of the mapping */
+  __u32 data_size;   /* A power of two */
+  __u32 reserved;
+};
+
+/*
+  First thing in the mapping. Both indexes run freely. The driver is the
+  producer of the receive ring and the consumer of the transmit ring.
+*/
+struct synccom_mmap_header {
+  __u32 head; /* Descriptors filled in, written by the producer */
+  __u32 tail; /* Descriptors handed back, written by the consumer */
+  __u32 reserved[14];
+};
+
+struct synccom_rx_desc {
+  __u32 offset;   /* Of the frame in the data area, modulo data_size */
+  __u32 length;   /* Frame data, not including the status bytes */
+  __u32 status;   /* The frame's two status bytes */
+  __u32 sequence; /* Counts up by one per received frame */
+  __s64 timestamp_sec;
+  __u32 timestamp_nsec;
+  __u32 reserved;
+};
+
+struct synccom_tx_desc {
+  __u32 offset;       /* Of the frame in the data area, modulo data_size */
+  __u32 length;
+  __s32 tx_modifiers; /* -1 for the port's tx_modifiers */
+  __u32 reserved;
+};
+
 extern struct list_head synccom_cards;
 
 #define COMMTECH_VENDOR_ID 0x18f7
@@ -437,6 +437,216 @@ static ssize_t output_memory_cap_show(struct kobject *kobj,
   return sprintf(buf, "%i\n", synccom_port_get_output_memory_cap(port));
 }
 
+static ssize_t rx_urb_count_store(struct kobject *kobj,
+                                  struct kobj_attribute *attr, const char *buf,
+                                  size_t count) {
+  struct synccom_port *port = 0;
+  struct synccom_rx_urbs rx_urbs;
+  char *end = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  SYNCCOM_RX_URBS_INIT(rx_urbs);
+
+  rx_urbs.count = (int)simple_strtoul(buf, &end, 10);
+
+  synccom_port_set_rx_urbs(port, &rx_urbs);
+
+  return count;
+}
+
+static ssize_t rx_urb_count_show(struct kobject *kobj,
+                                 struct kobj_attribute *attr, char *buf) {
+  struct synccom_port *port = 0;
+  struct synccom_rx_urbs rx_urbs;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  synccom_port_get_rx_urbs(port, &rx_urbs);
+
+  return sprintf(buf, "%i\n", rx_urbs.count);
+}
+
+static ssize_t rx_urb_size_store(struct kobject *kobj,
+                                 struct kobj_attribute *attr, const char *buf,
+                                 size_t count) {
+  struct synccom_port *port = 0;
+  struct synccom_rx_urbs rx_urbs;
+  char *end = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  SYNCCOM_RX_URBS_INIT(rx_urbs);
+
+  rx_urbs.size = (int)simple_strtoul(buf, &end, 10);
+
+  synccom_port_set_rx_urbs(port, &rx_urbs);
+
+  return count;
+}
+
+static ssize_t rx_urb_size_show(struct kobject *kobj,
+                                struct kobj_attribute *attr, char *buf) {
+  struct synccom_port *port = 0;
+  struct synccom_rx_urbs rx_urbs;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  synccom_port_get_rx_urbs(port, &rx_urbs);
+
+  return sprintf(buf, "%i\n", rx_urbs.size);
+}
+
+static ssize_t rx_coalesce_bytes_store(struct kobject *kobj,
+                                       struct kobj_attribute *attr,
+                                       const char *buf, size_t count) {
+  struct synccom_port *port = 0;
+  unsigned value = 0;
+  char *end = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  value = (unsigned)simple_strtoul(buf, &end, 10);
+
+  synccom_port_set_rx_coalesce_bytes(port, value);
+
+  return count;
+}
+
+static ssize_t rx_coalesce_bytes_show(struct kobject *kobj,
+                                      struct kobj_attribute *attr, char *buf) {
+  struct synccom_port *port = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  return sprintf(buf, "%i\n", synccom_port_get_rx_coalesce_bytes(port));
+}
+
+static ssize_t rx_coalesce_usecs_store(struct kobject *kobj,
+                                       struct kobj_attribute *attr,
+                                       const char *buf, size_t count) {
+  struct synccom_port *port = 0;
+  unsigned value = 0;
+  char *end = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  value = (unsigned)simple_strtoul(buf, &end, 10);
+
+  synccom_port_set_rx_coalesce_usecs(port, value);
+
+  return count;
+}
+
+static ssize_t rx_coalesce_usecs_show(struct kobject *kobj,
+                                      struct kobj_attribute *attr, char *buf) {
+  struct synccom_port *port = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  return sprintf(buf, "%i\n", synccom_port_get_rx_coalesce_usecs(port));
+}
+
+static ssize_t rx_watermark_bytes_store(struct kobject *kobj,
+                                        struct kobj_attribute *attr,
+                                        const char *buf, size_t count) {
+  struct synccom_port *port = 0;
+  unsigned value = 0;
+  char *end = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  value = (unsigned)simple_strtoul(buf, &end, 10);
+
+  synccom_port_set_rx_watermark_bytes(port, value);
+
+  return count;
+}
+
+static ssize_t rx_watermark_bytes_show(struct kobject *kobj,
+                                       struct kobj_attribute *attr, char *buf) {
+  struct synccom_port *port = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  return sprintf(buf, "%i\n", synccom_port_get_rx_watermark_bytes(port));
+}
+
+static ssize_t rx_watermark_usecs_store(struct kobject *kobj,
+                                        struct kobj_attribute *attr,
+                                        const char *buf, size_t count) {
+  struct synccom_port *port = 0;
+  unsigned value = 0;
+  char *end = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  value = (unsigned)simple_strtoul(buf, &end, 10);
+
+  synccom_port_set_rx_watermark_usecs(port, value);
+
+  return count;
+}
+
+static ssize_t rx_watermark_usecs_show(struct kobject *kobj,
+                                       struct kobj_attribute *attr, char *buf) {
+  struct synccom_port *port = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  return sprintf(buf, "%i\n", synccom_port_get_rx_watermark_usecs(port));
+}
+
+static ssize_t tx_aggregate_bytes_store(struct kobject *kobj,
+                                        struct kobj_attribute *attr,
+                                        const char *buf, size_t count) {
+  struct synccom_port *port = 0;
+  unsigned value = 0;
+  char *end = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  value = (unsigned)simple_strtoul(buf, &end, 10);
+
+  synccom_port_set_tx_aggregate_bytes(port, value);
+
+  return count;
+}
+
+static ssize_t tx_aggregate_bytes_show(struct kobject *kobj,
+                                       struct kobj_attribute *attr, char *buf) {
+  struct synccom_port *port = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  return sprintf(buf, "%i\n", synccom_port_get_tx_aggregate_bytes(port));
+}
+
+static ssize_t tx_aggregate_usecs_store(struct kobject *kobj,
+                                        struct kobj_attribute *attr,
+                                        const char *buf, size_t count) {
+  struct synccom_port *port = 0;
+  unsigned value = 0;
+  char *end = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  value = (unsigned)simple_strtoul(buf, &end, 10);
+
+  synccom_port_set_tx_aggregate_usecs(port, value);
+
+  return count;
+}
+
+static ssize_t tx_aggregate_usecs_show(struct kobject *kobj,
+                                       struct kobj_attribute *attr, char *buf) {
+  struct synccom_port *port = 0;
+
+  port = (struct synccom_port *)dev_get_drvdata((struct device *)kobj);
+
+  return sprintf(buf, "%i\n", synccom_port_get_tx_aggregate_usecs(port));
+}
+
 static struct kobj_attribute append_status_attribute =
     __ATTR(append_status, SYSFS_READ_WRITE_MODE, append_status_show,
            append_status_store);
@@ -463,11 +673,45 @@ static struct kobj_attribute rx_multiple_attribute = __ATTR(
 static struct kobj_attribute tx_modifiers_attribute = __ATTR(
     tx_modifiers, SYSFS_READ_WRITE_MODE, tx_modifiers_show, tx_modifiers_store);
 
+static struct kobj_attribute rx_urb_count_attribute = __ATTR(
+    rx_urb_count, SYSFS_READ_WRITE_MODE, rx_urb_count_show, rx_urb_count_store);
+
+static struct kobj_attribute rx_urb_size_attribute = __ATTR(
+    rx_urb_size, SYSFS_READ_WRITE_MODE, rx_urb_size_show, rx_urb_size_store);
+
+static struct kobj_attribute rx_coalesce_bytes_attribute =
+    __ATTR(rx_coalesce_bytes, SYSFS_READ_WRITE_MODE, rx_coalesce_bytes_show,
+           rx_coalesce_bytes_store);
+
+static struct kobj_attribute rx_coalesce_usecs_attribute =
+    __ATTR(rx_coalesce_usecs, SYSFS_READ_WRITE_MODE, rx_coalesce_usecs_show,
+           rx_coalesce_usecs_store);
+
+static struct kobj_attribute rx_watermark_bytes_attribute =
+    __ATTR(rx_watermark_bytes, SYSFS_READ_WRITE_MODE, rx_watermark_bytes_show,
+           rx_watermark_bytes_store);
+
+static struct kobj_attribute rx_watermark_usecs_attribute =
+    __ATTR(rx_watermark_usecs, SYSFS_READ_WRITE_MODE, rx_watermark_usecs_show,
+           rx_watermark_usecs_store);
+
+static struct kobj_attribute tx_aggregate_bytes_attribute =
+    __ATTR(tx_aggregate_bytes, SYSFS_READ_WRITE_MODE, tx_aggregate_bytes_show,
+           tx_aggregate_bytes_store);
+
+static struct kobj_attribute tx_aggregate_usecs_attribute =
+    __ATTR(tx_aggregate_usecs, SYSFS_READ_WRITE_MODE, tx_aggregate_usecs_show,
+           tx_aggregate_usecs_store);
+
 static struct attribute *settings_attrs[] = {
     &append_status_attribute.attr,    &append_timestamp_attribute.attr,
     &input_memory_cap_attribute.attr, &output_memory_cap_attribute.attr,
     &ignore_timeout_attribute.attr,   &rx_multiple_attribute.attr,
-    &tx_modifiers_attribute.attr,     NULL,
+    &tx_modifiers_attribute.attr,     &rx_urb_count_attribute.attr,
+    &rx_urb_size_attribute.attr,      &rx_coalesce_bytes_attribute.attr,
+    &rx_coalesce_usecs_attribute.attr, &tx_aggregate_bytes_attribute.attr,
+    &tx_aggregate_usecs_attribute.attr, &rx_watermark_bytes_attribute.attr,
+    &rx_watermark_usecs_attribute.attr, NULL,
 };
 
 struct attribute_group port_settings_attr_group = {
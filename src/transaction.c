@@ -0,0 +1,529 @@
+/*
+Copyright 2022 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <linux/slab.h>    /* kmalloc, kfree */
+#include <linux/version.h> /* LINUX_VERSION_CODE, KERNEL_VERSION */
+
+#include "port.h" /* struct synccom_port */
+#include "transaction.h"
+#include "utils.h" /* return_{val_}if_untrue, port_offset */
+
+#define SYNCCOM_TRANSACTION_DEFAULT_SLOT_SIZE 64
+
+static void synccom_transaction_start_next(struct synccom_port *port);
+static void synccom_transaction_finish(struct synccom_transaction *transaction,
+                                       int status);
+static void command_callback(struct urb *urb);
+static void response_callback(struct urb *urb);
+
+static void synccom_transaction_free(struct synccom_transaction *transaction) {
+  usb_free_urb(transaction->command_urb);
+  usb_free_urb(transaction->response_urb);
+  kfree(transaction->command_buffer);
+  kfree(transaction->response_buffer);
+}
+
+static unsigned synccom_transaction_get_slot_size(struct synccom_port *port) {
+  struct usb_host_endpoint *ep;
+  unsigned slot_size = 0;
+
+  ep = usb_pipe_endpoint(port->udev,
+                         usb_sndbulkpipe(port->udev, REGISTER_WRITE_ENDPOINT));
+  if (ep)
+    slot_size = usb_endpoint_maxp(&ep->desc);
+
+  if (slot_size == 0 || slot_size > SYNCCOM_TRANSACTION_COMMAND_SIZE)
+    slot_size = SYNCCOM_TRANSACTION_DEFAULT_SLOT_SIZE;
+
+  return slot_size;
+}
+
+int synccom_transaction_pool_init(struct synccom_port *port) {
+  unsigned slot_size = 0;
+  unsigned i = 0;
+
+  return_val_if_untrue(port, -EINVAL);
+
+  spin_lock_init(&port->transaction_spinlock);
+  init_waitqueue_head(&port->transaction_queue);
+  INIT_LIST_HEAD(&port->free_transactions);
+  INIT_LIST_HEAD(&port->queued_transactions);
+  port->active_transaction = 0;
+
+  port->transactions = kcalloc(SYNCCOM_TRANSACTION_POOL_SIZE,
+                               sizeof(*port->transactions), GFP_KERNEL);
+  if (!port->transactions)
+    return -ENOMEM;
+
+  slot_size = synccom_transaction_get_slot_size(port);
+
+  for (i = 0; i < SYNCCOM_TRANSACTION_POOL_SIZE; i++) {
+    struct synccom_transaction *transaction = &port->transactions[i];
+
+    transaction->port = port;
+    transaction->slot_size = slot_size;
+    transaction->max_commands = SYNCCOM_TRANSACTION_COMMAND_SIZE / slot_size;
+    if (transaction->max_commands > SYNCCOM_TRANSACTION_MAX_COMMANDS)
+      transaction->max_commands = SYNCCOM_TRANSACTION_MAX_COMMANDS;
+
+    init_completion(&transaction->done);
+
+    transaction->command_urb = usb_alloc_urb(0, GFP_KERNEL);
+    transaction->response_urb = usb_alloc_urb(0, GFP_KERNEL);
+    transaction->command_buffer =
+        kzalloc(SYNCCOM_TRANSACTION_COMMAND_SIZE, GFP_KERNEL);
+    transaction->response_buffer =
+        kmalloc(SYNCCOM_TRANSACTION_MAX_COMMANDS *
+                    SYNCCOM_TRANSACTION_MAX_RESPONSE,
+                GFP_KERNEL);
+
+    if (!transaction->command_urb || !transaction->response_urb ||
+        !transaction->command_buffer || !transaction->response_buffer) {
+      dev_err(port->device, "%s: couldn't allocate transaction %i\n",
+              __func__, i);
+      synccom_transaction_free(transaction);
+      synccom_transaction_pool_delete(port);
+      return -ENOMEM;
+    }
+
+    list_add_tail(&transaction->list, &port->free_transactions);
+  }
+
+  return 0;
+}
+
+void synccom_transaction_pool_delete(struct synccom_port *port) {
+  struct synccom_transaction *transaction = 0;
+  struct synccom_transaction *temp = 0;
+  unsigned long flags;
+  LIST_HEAD(queued);
+
+  return_if_untrue(port);
+
+  if (!port->transactions)
+    return;
+
+  /* Anything still queued would never be started again, fail it now. */
+  spin_lock_irqsave(&port->transaction_spinlock, flags);
+  list_splice_init(&port->queued_transactions, &queued);
+  transaction = port->active_transaction;
+  spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+
+  if (transaction) {
+    usb_kill_urb(transaction->command_urb);
+    usb_kill_urb(transaction->response_urb);
+  }
+
+  list_for_each_entry_safe(transaction, temp, &queued, list) {
+    list_del(&transaction->list);
+    synccom_transaction_finish(transaction, -ESHUTDOWN);
+  }
+
+  /* Every transaction is back in the free list by now. */
+  list_for_each_entry_safe(transaction, temp, &port->free_transactions, list) {
+    list_del(&transaction->list);
+    synccom_transaction_free(transaction);
+  }
+
+  kfree(port->transactions);
+  port->transactions = 0;
+}
+
+struct synccom_transaction *
+synccom_transaction_try_get(struct synccom_port *port) {
+  struct synccom_transaction *transaction = 0;
+  unsigned long flags;
+
+  spin_lock_irqsave(&port->transaction_spinlock, flags);
+  if (!list_empty(&port->free_transactions)) {
+    transaction = list_first_entry(&port->free_transactions,
+                                   struct synccom_transaction, list);
+    list_del(&transaction->list);
+  }
+  spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+
+  if (transaction) {
+    transaction->num_commands = 0;
+    transaction->command_length = 0;
+    transaction->response_length = 0;
+    transaction->response_received = 0;
+    transaction->num_responses = 0;
+    transaction->status = 0;
+    transaction->async = 0;
+    transaction->callback = 0;
+    transaction->context = 0;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 13, 0)
+    INIT_COMPLETION(transaction->done);
+#else
+    reinit_completion(&transaction->done);
+#endif
+  }
+
+  return transaction;
+}
+
+/*
+  Sleeps until one of the preallocated transactions is free. Returns 0 if the
+  task is killed while waiting.
+
+  Callers that need register_access_mutex have to take it before getting a
+  transaction, never while holding one.
+*/
+struct synccom_transaction *synccom_transaction_get(struct synccom_port *port) {
+  struct synccom_transaction *transaction = 0;
+
+  return_val_if_untrue(port, 0);
+  return_val_if_untrue(port->transactions, 0);
+
+  if (wait_event_killable(port->transaction_queue,
+                          (transaction = synccom_transaction_try_get(port)) !=
+                              0))
+    return 0;
+
+  return transaction;
+}
+
+void synccom_transaction_put(struct synccom_transaction *transaction) {
+  struct synccom_port *port = 0;
+  unsigned long flags;
+
+  return_if_untrue(transaction);
+
+  port = transaction->port;
+
+  spin_lock_irqsave(&port->transaction_spinlock, flags);
+  list_add_tail(&transaction->list, &port->free_transactions);
+  spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+
+  wake_up(&port->transaction_queue);
+}
+
+unsigned synccom_transaction_is_full(struct synccom_transaction *transaction) {
+  return transaction->num_commands >= transaction->max_commands;
+}
+
+/*
+  Returns the index of the command's response (to be passed to
+  synccom_transaction_get_response) or a negative value on error. Commands
+  without a response return 0 on success.
+*/
+int synccom_transaction_add_command(struct synccom_transaction *transaction,
+                                    const unsigned char *command,
+                                    unsigned length, unsigned response_length) {
+  unsigned char *slot = 0;
+  int index = 0;
+
+  return_val_if_untrue(transaction, -EINVAL);
+  return_val_if_untrue(length > 0 && length <= transaction->slot_size,
+                       -EINVAL);
+  return_val_if_untrue(response_length <= SYNCCOM_TRANSACTION_MAX_RESPONSE,
+                       -EINVAL);
+
+  if (synccom_transaction_is_full(transaction))
+    return -ENOSPC;
+
+  slot = transaction->command_buffer +
+         transaction->num_commands * transaction->slot_size;
+
+  /* Pad the previous command out to a full packet so this one starts its own
+     packet. The last command is sent as a short packet which ends the
+     transfer. */
+  if (transaction->num_commands) {
+    unsigned used = transaction->command_length -
+                    (transaction->num_commands - 1) * transaction->slot_size;
+
+    memset(slot - transaction->slot_size + used, 0,
+           transaction->slot_size - used);
+  }
+
+  memcpy(slot, command, length);
+  transaction->command_length = (slot - transaction->command_buffer) + length;
+  transaction->num_commands++;
+
+  if (response_length == 0)
+    return 0;
+
+  index = transaction->num_responses++;
+  transaction->response_offsets[index] = transaction->response_length;
+  transaction->response_length += response_length;
+
+  return index;
+}
+
+int synccom_transaction_add_write(struct synccom_transaction *transaction,
+                                  unsigned bar, unsigned register_offset,
+                                  __u32 value) {
+  unsigned char command[7];
+  unsigned offset = 0;
+
+  return_val_if_untrue(transaction, -EINVAL);
+  return_val_if_untrue(bar <= 2, -EINVAL);
+
+  offset = port_offset(transaction->port, bar, register_offset);
+
+  command[0] = SYNCCOM_WRITE_REGISTER;
+  command[1] = (offset >> 8) & 0xFF;
+  command[2] = offset & 0xFF;
+  command[3] = (value >> 24) & 0xFF;
+  command[4] = (value >> 16) & 0xFF;
+  command[5] = (value >> 8) & 0xFF;
+  command[6] = value & 0xFF;
+
+  return synccom_transaction_add_command(transaction, command, sizeof(command),
+                                         0);
+}
+
+int synccom_transaction_add_read(struct synccom_transaction *transaction,
+                                 unsigned bar, unsigned register_offset) {
+  unsigned char command[3];
+  unsigned offset = 0;
+
+  return_val_if_untrue(transaction, -EINVAL);
+  return_val_if_untrue(bar <= 2, -EINVAL);
+
+  offset = port_offset(transaction->port, bar, register_offset);
+
+  command[0] = SYNCCOM_READ_REGISTER;
+  command[1] = (offset >> 8) & 0xFF;
+  command[2] = offset & 0xFF;
+
+  return synccom_transaction_add_command(transaction, command, sizeof(command),
+                                         4);
+}
+
+/* Called from URB completion context with no locks held. */
+static void synccom_transaction_finish(struct synccom_transaction *transaction,
+                                       int status) {
+  struct synccom_port *port = transaction->port;
+  unsigned long flags;
+
+  transaction->status = status;
+
+  spin_lock_irqsave(&port->transaction_spinlock, flags);
+  if (port->active_transaction == transaction)
+    port->active_transaction = 0;
+  spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+
+  if (transaction->async) {
+    if (transaction->callback)
+      transaction->callback(transaction);
+
+    synccom_transaction_put(transaction);
+  } else {
+    complete(&transaction->done);
+  }
+
+  synccom_transaction_start_next(port);
+}
+
+static int synccom_transaction_submit_response(
+    struct synccom_transaction *transaction) {
+  struct synccom_port *port = transaction->port;
+
+  usb_fill_bulk_urb(
+      transaction->response_urb, port->udev,
+      usb_rcvbulkpipe(port->udev, REGISTER_READ_ENDPOINT),
+      transaction->response_buffer + transaction->response_received,
+      transaction->response_length - transaction->response_received,
+      response_callback, transaction);
+
+  return usb_submit_urb(transaction->response_urb, GFP_ATOMIC);
+}
+
+static void command_callback(struct urb *urb) {
+  struct synccom_transaction *transaction = urb->context;
+  int status = urb->status;
+
+  if (status == 0 && transaction->response_length)
+    status = synccom_transaction_submit_response(transaction);
+  else if (status)
+    dev_dbg(transaction->port->device, "%s: status %i\n", __func__, status);
+
+  if (status || transaction->response_length == 0)
+    synccom_transaction_finish(transaction, status);
+}
+
+/* Each response arrives as its own short packet so keep resubmitting for the
+   remainder until every response has been collected. */
+static void response_callback(struct urb *urb) {
+  struct synccom_transaction *transaction = urb->context;
+  int status = urb->status;
+
+  if (status == 0) {
+    transaction->response_received += urb->actual_length;
+
+    if (transaction->response_received < transaction->response_length)
+      status = synccom_transaction_submit_response(transaction);
+    else
+      return synccom_transaction_finish(transaction, 0);
+  } else {
+    dev_dbg(transaction->port->device, "%s: status %i\n", __func__, status);
+  }
+
+  if (status)
+    synccom_transaction_finish(transaction, status);
+}
+
+/* Starts the oldest queued transaction if nothing is on the wire. */
+static void synccom_transaction_start_next(struct synccom_port *port) {
+  struct synccom_transaction *transaction = 0;
+  unsigned long flags;
+  int status = 0;
+
+  spin_lock_irqsave(&port->transaction_spinlock, flags);
+  if (port->active_transaction || list_empty(&port->queued_transactions)) {
+    spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+    return;
+  }
+
+  transaction = list_first_entry(&port->queued_transactions,
+                                 struct synccom_transaction, list);
+  list_del(&transaction->list);
+  port->active_transaction = transaction;
+  spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+
+  usb_fill_bulk_urb(transaction->command_urb, port->udev,
+                    usb_sndbulkpipe(port->udev, REGISTER_WRITE_ENDPOINT),
+                    transaction->command_buffer, transaction->command_length,
+                    command_callback, transaction);
+
+  status = usb_submit_urb(transaction->command_urb, GFP_ATOMIC);
+  if (status) {
+    dev_dbg(port->device, "%s: usb_submit_urb failed (%i)\n", __func__,
+            status);
+    synccom_transaction_finish(transaction, status);
+  }
+}
+
+static int synccom_transaction_queue(struct synccom_transaction *transaction) {
+  struct synccom_port *port = transaction->port;
+  unsigned long flags;
+
+  if (transaction->num_commands == 0)
+    return -EINVAL;
+
+  spin_lock_irqsave(&port->transaction_spinlock, flags);
+  list_add_tail(&transaction->list, &port->queued_transactions);
+  spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+
+  synccom_transaction_start_next(port);
+
+  return 0;
+}
+
+/*
+  Queues the transaction and returns immediately. The callback is called from
+  URB completion (atomic) context once every response has arrived, after which
+  the transaction is returned to the pool.
+*/
+int synccom_transaction_submit(struct synccom_transaction *transaction,
+                               synccom_transaction_callback callback,
+                               void *context) {
+  int status = 0;
+
+  return_val_if_untrue(transaction, -EINVAL);
+
+  transaction->async = 1;
+  transaction->callback = callback;
+  transaction->context = context;
+
+  status = synccom_transaction_queue(transaction);
+  if (status)
+    synccom_transaction_put(transaction);
+
+  return status;
+}
+
+/*
+  Queues the transaction and sleeps until it has finished. The caller still
+  owns the transaction afterwards and has to synccom_transaction_put it once
+  it is done with the responses.
+*/
+int synccom_transaction_execute(struct synccom_transaction *transaction) {
+  struct synccom_port *port = 0;
+  unsigned long flags;
+  int status = 0;
+
+  return_val_if_untrue(transaction, -EINVAL);
+
+  port = transaction->port;
+
+  status = synccom_transaction_queue(transaction);
+  if (status)
+    return status;
+
+  if (wait_for_completion_timeout(&transaction->done,
+                                  SYNCCOM_TRANSACTION_TIMEOUT))
+    return transaction->status;
+
+  spin_lock_irqsave(&port->transaction_spinlock, flags);
+  if (port->active_transaction != transaction &&
+      !completion_done(&transaction->done)) {
+    /* Still waiting behind another transaction, it never hit the wire. */
+    list_del(&transaction->list);
+    spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+    return -ETIMEDOUT;
+  }
+  spin_unlock_irqrestore(&port->transaction_spinlock, flags);
+
+  usb_kill_urb(transaction->command_urb);
+  usb_kill_urb(transaction->response_urb);
+  wait_for_completion(&transaction->done);
+
+  dev_dbg(port->device, "%s: transaction timed out\n", __func__);
+
+  return -ETIMEDOUT;
+}
+
+const unsigned char *
+synccom_transaction_get_response(struct synccom_transaction *transaction,
+                                 int index) {
+  return_val_if_untrue(transaction, 0);
+  return_val_if_untrue(index >= 0 &&
+                           (unsigned)index < transaction->num_responses,
+                       0);
+
+  return transaction->response_buffer + transaction->response_offsets[index];
+}
+
+/* Register values are the last four bytes of a response, most significant
+   byte first. */
+__u32 synccom_transaction_get_value(struct synccom_transaction *transaction,
+                                    int index) {
+  const unsigned char *response = 0;
+  unsigned end = 0;
+
+  response = synccom_transaction_get_response(transaction, index);
+  if (!response)
+    return 0;
+
+  end = ((unsigned)index + 1 < transaction->num_responses)
+            ? transaction->response_offsets[index + 1]
+            : transaction->response_length;
+  if (end - transaction->response_offsets[index] < 4)
+    return 0;
+
+  response += end - transaction->response_offsets[index] - 4;
+
+  return ((__u32)response[0] << 24) | ((__u32)response[1] << 16) |
+         ((__u32)response[2] << 8) | response[3];
+}
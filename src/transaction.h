@@ -0,0 +1,108 @@
+/*
+Copyright 2022 Commtech, Inc.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SYNCCOM_TRANSACTION_H
+#define SYNCCOM_TRANSACTION_H
+
+#include <linux/completion.h> /* struct completion */
+#include <linux/list.h>       /* struct list_head */
+#include <linux/usb.h>        /* struct urb */
+
+#define SYNCCOM_TRANSACTION_POOL_SIZE 4
+#define SYNCCOM_TRANSACTION_COMMAND_SIZE 4096
+#define SYNCCOM_TRANSACTION_MAX_COMMANDS 64
+#define SYNCCOM_TRANSACTION_MAX_RESPONSE 8
+#define SYNCCOM_TRANSACTION_TIMEOUT (HZ * 10)
+
+struct synccom_port;
+struct synccom_transaction;
+
+typedef void (*synccom_transaction_callback)(
+    struct synccom_transaction *transaction);
+
+/*
+  A batch of firmware commands sent to the register endpoint in one bulk
+  transfer, with all of their responses collected from the register read
+  endpoint before the transaction completes.
+
+  The firmware handles one command per packet, so every command is placed at
+  the start of its own wMaxPacketSize slot of the transfer. Each response
+  arrives as its own short packet and is appended to the response buffer in
+  the order the commands were added.
+*/
+struct synccom_transaction {
+  struct list_head list;
+  struct synccom_port *port;
+
+  struct urb *command_urb;
+  struct urb *response_urb;
+  unsigned char *command_buffer;
+  unsigned char *response_buffer;
+
+  unsigned slot_size;    /* wMaxPacketSize of REGISTER_WRITE_ENDPOINT */
+  unsigned max_commands; /* slots that fit in command_buffer */
+
+  unsigned num_commands;
+  unsigned command_length;
+  unsigned response_length;
+  unsigned response_received;
+
+  unsigned num_responses;
+  unsigned response_offsets[SYNCCOM_TRANSACTION_MAX_COMMANDS];
+
+  int status;
+  unsigned async;
+  synccom_transaction_callback callback;
+  void *context;
+  struct completion done;
+};
+
+int synccom_transaction_pool_init(struct synccom_port *port);
+void synccom_transaction_pool_delete(struct synccom_port *port);
+
+struct synccom_transaction *synccom_transaction_get(struct synccom_port *port);
+struct synccom_transaction *
+synccom_transaction_try_get(struct synccom_port *port);
+void synccom_transaction_put(struct synccom_transaction *transaction);
+
+unsigned synccom_transaction_is_full(struct synccom_transaction *transaction);
+int synccom_transaction_add_command(struct synccom_transaction *transaction,
+                                    const unsigned char *command,
+                                    unsigned length, unsigned response_length);
+int synccom_transaction_add_write(struct synccom_transaction *transaction,
+                                  unsigned bar, unsigned register_offset,
+                                  __u32 value);
+int synccom_transaction_add_read(struct synccom_transaction *transaction,
+                                 unsigned bar, unsigned register_offset);
+
+int synccom_transaction_execute(struct synccom_transaction *transaction);
+int synccom_transaction_submit(struct synccom_transaction *transaction,
+                               synccom_transaction_callback callback,
+                               void *context);
+
+const unsigned char *
+synccom_transaction_get_response(struct synccom_transaction *transaction,
+                                 int index);
+__u32 synccom_transaction_get_value(struct synccom_transaction *transaction,
+                                    int index);
+
+#endif
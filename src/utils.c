@@ -95,6 +95,32 @@ unsigned is_read_only_register(unsigned offset) {
   return 0;
 }
 
+/*
+  Registers whose value can only change through the driver, so reads can be
+  served from register_storage. FCR is left out because it is shared with the
+  other port on the card, and VSTR so the revision getters always ask the
+  card.
+*/
+unsigned is_cacheable_register(unsigned bar, unsigned offset) {
+  if (bar != 0 || offset > MAX_OFFSET)
+    return 0;
+
+  switch (offset) {
+  case FIFO_OFFSET:
+  case BC_FIFO_L_OFFSET:
+  case FIFO_BC_OFFSET:
+  case FIFO_FC_OFFSET:
+  case CMDR_OFFSET:
+  case STAR_OFFSET:
+  case VSTR_OFFSET:
+  case ISR_OFFSET:
+  case FCR_OFFSET:
+    return 0;
+  }
+
+  return 1;
+}
+
 unsigned port_offset(struct synccom_port *port, unsigned bar, unsigned offset) {
   switch (bar) {
   case 0:
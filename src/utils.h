@@ -52,6 +52,7 @@ __u32 chars_to_u32(const char *data);
 int str_to_register_offset(const char *str);
 int str_to_interrupt_offset(const char *str);
 unsigned is_read_only_register(unsigned offset);
+unsigned is_cacheable_register(unsigned bar, unsigned offset);
 unsigned port_offset(struct synccom_port *port, unsigned bar, unsigned offset);
 
 unsigned is_synccom_device(struct pci_dev *pdev);